@@ -34,7 +34,8 @@ COMPONENTS =
 # enable the reconstruction display in GUI
 COMPONENTS += RECON_DISPLAY
 
-# enable the usage of original PrimEx clustering method
+# compile the original fortran code of PrimEx clustering method, it is used to
+# validate the c++ port
 COMPONENTS += PRIMEX_CLUSTER
 
 ######################################################################
@@ -47,6 +48,8 @@ COMPONENTS += PRIMEX_CLUSTER
 
 CONFIG += c++11
 QMAKE_CXXFLAGS += -std=c++11
+# let compiler vectorize the loops in clustering and decoding
+QMAKE_CXXFLAGS += -ftree-vectorize
 
 OBJECTS_DIR = obj
 MOC_DIR = qt_moc
@@ -74,17 +77,23 @@ HEADERS += include/PRadEventViewer.h \
            include/PRadDetector.h \
            include/PRadEvioParser.h \
            include/PRadDSTParser.h \
+           include/PRadCalibCache.h \
            include/PRadDataHandler.h \
            include/PRadInfoCenter.h \
            include/datastruct.h \
            include/PRadEventStruct.h \
            include/PRadException.h \
            include/PRadBenchMark.h \
+           include/PRadHistogram.h \
+           include/PRadPedestalEstimator.h \
+           include/PRadFitDriver.h \
+           include/PRadTaskPool.h \
            include/PRadEventFilter.h \
            include/PRadCoordSystem.h \
            include/PRadDetMatch.h \
            include/PRadHyCalSystem.h \
            include/PRadHyCalDetector.h \
+           include/PRadVectorPool.h \
            include/PRadHyCalModule.h \
            include/PRadCalibConst.h \
            include/PRadDAQChannel.h \
@@ -94,6 +103,8 @@ HEADERS += include/PRadEventViewer.h \
            include/PRadHyCalCluster.h \
            include/PRadSquareCluster.h \
            include/PRadIslandCluster.h \
+           include/PRadPrimexIsland.h \
+           include/PRadPrimexCluster.h \
            include/PRadGEMSystem.h \
            include/PRadGEMDetector.h \
            include/PRadGEMPlane.h \
@@ -121,10 +132,15 @@ SOURCES += src/main.cpp \
            src/PRadDetector.cpp \
            src/PRadEvioParser.cpp \
            src/PRadDSTParser.cpp \
+           src/PRadCalibCache.cpp \
            src/PRadDataHandler.cpp \
            src/PRadInfoCenter.cpp \
            src/PRadException.cpp \
            src/PRadBenchMark.cpp \
+           src/PRadHistogram.cpp \
+           src/PRadPedestalEstimator.cpp \
+           src/PRadFitDriver.cpp \
+           src/PRadTaskPool.cpp \
            src/PRadEventFilter.cpp \
            src/PRadCoordSystem.cpp \
            src/PRadDetMatch.cpp \
@@ -139,6 +155,8 @@ SOURCES += src/main.cpp \
            src/PRadHyCalCluster.cpp \
            src/PRadSquareCluster.cpp \
            src/PRadIslandCluster.cpp \
+           src/PRadPrimexIsland.cpp \
+           src/PRadPrimexCluster.cpp \
            src/PRadGEMSystem.cpp \
            src/PRadGEMDetector.cpp \
            src/PRadGEMPlane.cpp \
@@ -203,8 +221,6 @@ contains(COMPONENTS, RECON_DISPLAY) {
 
 contains(COMPONENTS, PRIMEX_CLUSTER) {
     DEFINES += USE_PRIMEX_METHOD
-    SOURCES += src/PRadPrimexCluster.cpp
-    HEADERS += include/PRadPrimexCluster.h
     FORTRAN_SOURCES += fortran/island.F
     fortran.output = $${OBJECTS_DIR}/${QMAKE_FILE_BASE}.o
     fortran.commands = gfortran -c ${QMAKE_FILE_NAME} -Ifortran -o ${QMAKE_FILE_OUT}
@@ -51,6 +51,9 @@ void testHyCalCluster(const string &file, PRadHyCalSystem *sys)
 
     int count = 0;
     double time = 0;
+    // heap allocations in the reconstruction, only counted if the library is
+    // built with COUNT_ALLOC component
+    uint64_t allocs = 0;
     while(dst_parser->Read())
     {
         if(dst_parser->EventType() == PRadDSTParser::Type::event) {
@@ -71,7 +74,9 @@ void testHyCalCluster(const string &file, PRadHyCalSystem *sys)
                      << "---[ " << time/(double)count << " ms/ev ]------"
                      << "\r" << flush;
             }
+            uint64_t alloc_begin = PRadBenchMark::GetAllocationCount();
             sys->Reconstruct(event);
+            allocs += PRadBenchMark::GetAllocationCount() - alloc_begin;
         }
     }
 
@@ -82,4 +87,10 @@ void testHyCalCluster(const string &file, PRadHyCalSystem *sys)
          << "using method " << sys->GetClusterMethodName() << ", "
          << "took " << time/1000. << " s."
          << endl;
+
+    if(PRadBenchMark::IsCountingAllocations()) {
+        cout << "ALLOC: " << allocs << " heap allocations in reconstruction, "
+             << (count ? allocs/(double)count : 0.) << " per event."
+             << endl;
+    }
 }
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <unordered_map>
 #include "PRadDAQChannel.h"
+#include "PRadHistogram.h"
+#include "PRadPedestalEstimator.h"
 #include "TH1.h"
 
 
@@ -73,16 +75,25 @@ public:
     bool AddHist(const std::string &name, TH1 *hist);
     bool MapHist(const std::string &name, int trg);
     void RemoveHist(const std::string &name);
+    // the histograms can be filled from several threads, but the pedestal
+    // estimator cannot, so a channel is filled by one thread at a time
     template<typename T>
     void FillHist(const T& t, int trg)
     {
         if(trg_hist[trg]) {
             trg_hist[trg]->Fill(t);
+            // pedestal is estimated on the fly
+            if(trg_hist[trg] == ped_hist)
+                ped_est.Fill(t);
         }
     };
     TH1 *GetHist(const std::string &name = "Physics") const;
-    TH1 *GetHist(PRadTriggerType type) const {return trg_hist[(int)type];};
+    TH1 *GetHist(PRadTriggerType type) const
+    {
+        return trg_hist[(int)type] ? trg_hist[(int)type]->GetHist() : nullptr;
+    };
     std::vector<TH1*> GetHistList() const;
+    const PRadPedestalEstimator &GetPedestalEstimator() const {return ped_est;};
 
 protected:
     PRadHyCalModule *module;
@@ -91,9 +102,12 @@ protected:
     int occupancy;
     unsigned short sparsify;
     unsigned short adc_value;
-    // histograms
-    std::vector<TH1*> trg_hist;
-    std::unordered_map<std::string, TH1*> hist_map;
+    // histograms, filled without lock, the ROOT histograms are only updated
+    // when they are requested
+    std::vector<PRadHistogram*> trg_hist;
+    std::unordered_map<std::string, PRadHistogram*> hist_map;
+    PRadHistogram *ped_hist;
+    PRadPedestalEstimator ped_est;
 };
 
 std::ostream &operator <<(std::ostream &os, const PRadADCChannel::Pedestal &ped);
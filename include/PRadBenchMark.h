@@ -9,6 +9,7 @@
 #define PRAD_BENCH_MARK_H
 
 #include <chrono>
+#include <cstdint>
 
 class PRadBenchMark
 {
@@ -17,9 +18,17 @@ public:
     ~PRadBenchMark();
     void Reset();
     unsigned int GetElapsedTime() const;
+    uint64_t GetAllocations() const;
+
+public:
+    // heap allocations are only counted if the library is built with
+    // COUNT_ALLOCATIONS, the count is always 0 otherwise
+    static bool IsCountingAllocations();
+    static uint64_t GetAllocationCount();
 
 private:
     std::chrono::time_point<std::chrono::high_resolution_clock> time_point;
+    uint64_t alloc_count;
 };
 
 #endif
@@ -0,0 +1,65 @@
+#ifndef PRAD_CALIB_CACHE_H
+#define PRAD_CALIB_CACHE_H
+
+#include <string>
+#include <cstdint>
+
+// default directory for the cache files
+#define DEFAULT_CALIB_CACHE_DIR "calib_cache"
+// change it when the file layout changes
+#define CALIB_CACHE_VERSION 2
+
+class PRadHyCalSystem;
+class PRadGEMSystem;
+
+// keeps the results of the initialization from data (HyCal pedestals, gain
+// corrected calibration factors and GEM pedestals) for each run, so they do
+// not need to be fitted again when the run is opened next time
+// a cache file is only used if the data file and the inputs of the systems
+// are the same as when it was written
+class PRadCalibCache
+{
+public:
+    // file header
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        int32_t run;
+        int32_t ref;
+        int32_t sampling;
+        uint32_t reserved;
+        uint64_t file_size;
+        int64_t file_time;
+        uint64_t input_hash;
+
+        Header()
+        : magic(0), version(0), run(0), ref(0), sampling(0), reserved(0),
+          file_size(0), file_time(0), input_hash(0)
+        {};
+    };
+
+public:
+    PRadCalibCache(const std::string &dir = DEFAULT_CALIB_CACHE_DIR);
+
+    // empty directory disables the cache
+    void SetDirectory(const std::string &dir) {directory = dir;};
+    const std::string &GetDirectory() const {return directory;};
+    bool IsEnabled() const {return !directory.empty();};
+
+    std::string GetCachePath(int run) const;
+    bool Load(const std::string &data_path, int run, int ref, bool sampling,
+              PRadHyCalSystem *hycal, PRadGEMSystem *gem) const;
+    bool Save(const std::string &data_path, int run, int ref, bool sampling,
+              const PRadHyCalSystem *hycal, const PRadGEMSystem *gem) const;
+
+private:
+    bool makeHeader(Header &header, const std::string &data_path,
+                    int run, int ref, bool sampling,
+                    const PRadHyCalSystem *hycal, const PRadGEMSystem *gem) const;
+
+private:
+    std::string directory;
+};
+
+#endif
@@ -13,6 +13,7 @@ class PRadCalibConst
 public:
     friend class PRadHyCalModule;
     friend class PRadDSTParser;
+    friend class PRadCalibCache;
 
 public:
     PRadCalibConst(int ref_num = DEFAULT_REF_NUM);
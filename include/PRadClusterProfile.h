@@ -2,9 +2,15 @@
 #define PRAD_CLUSTER_PROFILE_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <cmath>
 #include "PRadHyCalDetector.h"
 #include "PRadEventStruct.h"
 
+// alignment of the profile buffer, one cache line
+#define PROFILE_ALIGNMENT 64
+
 class PRadClusterProfile
 {
 public:
@@ -17,6 +23,27 @@ public:
         Profile(float f, float e) : frac(f), err(e) {};
     };
 
+    // half-size profile, the values are quantized to 16 bit integers
+    struct QProfile
+    {
+        uint16_t frac;
+        uint16_t err;
+
+        QProfile() : frac(0), err(0) {};
+        QProfile(uint16_t f, uint16_t e) : frac(f), err(e) {};
+    };
+
+    // precomputed quantized distance between a PbWO4 and a PbGlass module
+    struct TransPair
+    {
+        uint32_t key;
+        uint16_t dx;
+        uint16_t dy;
+
+        TransPair() : key(0), dx(0), dy(0) {};
+        TransPair(uint32_t k, int x, int y) : key(k), dx(x), dy(y) {};
+    };
+
 public:
     static PRadClusterProfile &Instance()
     {
@@ -35,26 +62,95 @@ public:
     PRadClusterProfile &operator =(const PRadClusterProfile &rhs) = delete;
     PRadClusterProfile &operator =(PRadClusterProfile &&rhs) = delete;
 
-    void Resize(int type, int xsize, int ysize);
+    void Resize(int type, int size);
+    void SetQuantized(bool q);
     void Clear();
     void LoadProfile(int type, const std::string &path);
-    const Profile &GetProfile(int type, int x, int y) const;
-    const Profile &GetProfile(const ModuleHit &m1, const ModuleHit &m2) const;
-    const Profile &GetProfile(const float &x, const float &y, const ModuleHit &hit) const;
+    void BuildTransitionTable(const std::vector<PRadHyCalModule*> &mlist);
+    void ClearTransitionTable();
+    Profile GetProfile(const ModuleHit &m1, const ModuleHit &m2) const;
+    Profile GetProfile(const float &x, const float &y, const ModuleHit &hit) const;
+    void GetFractions(int type, const int *x, const int *y, size_t n,
+                      const float &scale, float *frac) const;
     float EvalEstimator(const BaseHit &hit, const ModuleCluster &cluster) const;
+    bool IsInRange(const ModuleHit &center, const ModuleHit &hit, const double &max_size) const;
+
+    // 1 step has 0.01% difference, much smaller than the profiles' own error
+    // so we are not going to do interpolation
+    Profile GetProfile(int type, int x, int y)
+    const
+    {
+        if((unsigned int)x >= (unsigned int)steps ||
+           (unsigned int)y >= (unsigned int)steps)
+            return Profile();
+
+        size_t idx = index(type, x, y);
+        if(quantized)
+            return Profile(qprofiles[idx].frac*frac_scale[type],
+                           qprofiles[idx].err*err_scale[type]);
+
+        return profiles[idx];
+    }
+
+    bool IsQuantized() const {return quantized;};
+    int GetTypes() const {return types;};
+    int GetSteps() const {return steps;};
+    size_t GetMemorySize() const {return buffer_size;};
+
+public:
+    static int get_sector(const float &x, const float &y);
+    // distance in profile steps (1% of the module size)
+    static int quantize(const double &dist, const double &size)
+    {
+        return std::fabs(100.*dist/size) + 0.5;
+    }
+    // distance crossing the boundary, each part in the steps of its own module
+    static int quantize(const double &dist1, const double &size1,
+                        const double &dist2, const double &size2)
+    {
+        return std::fabs(100.*dist1/size1) + std::fabs(100.*dist2/size2) + 0.5;
+    }
 
 private:
-    PRadClusterProfile(int type = 2, int xsize = 501, int ysize = 501);
+    PRadClusterProfile(int type = 2, int size = 501);
     void reserve();
     void release();
+    void fill(int type, const std::vector<Profile> &table);
+
+    // the profile is symmetric in x and y, so only the half with x <= y is
+    // stored, all types are in one contiguous buffer
+    size_t index(int type, int x, int y)
+    const
+    {
+        int lo = (x < y) ? x : y;
+        int hi = (x < y) ? y : x;
+        return type*type_size + hi*(hi + 1)/2 + lo;
+    }
+
+    bool isTransModule(const ModuleHit &hit)
+    const
+    {
+        return (hit.id >= 0) && ((size_t)hit.id < trans_geo.size()) &&
+               (trans_geo[hit.id] == hit.geo_index);
+    }
 
 private:
     int types;
-    int x_steps;
-    int y_steps;
-    Profile ***profiles;
-    Profile empty_prof;
-    Profile trans_prof;
+    int steps;
+    bool quantized;
+    size_t type_size;
+    size_t buffer_size;
+    unsigned char *buffer;
+    Profile *profiles;
+    QProfile *qprofiles;
+    std::vector<float> frac_scale;
+    std::vector<float> err_scale;
+    // open addressing hash table for the transition module pairs
+    // geometry index of the modules in the table, it checks if the table still
+    // describes the hits, the distance is computed directly if not
+    std::vector<TransPair> trans_table;
+    std::vector<unsigned int> trans_geo;
+    int trans_shift;
 };
 
 #endif
@@ -6,11 +6,16 @@
 #include <unordered_map>
 #include "PRadEvioParser.h"
 #include "PRadDSTParser.h"
+#include "PRadCalibCache.h"
 #include "PRadEventStruct.h"
 #include "PRadException.h"
 
 // PMT 0 - 2
 #define DEFAULT_REF_PMT 2
+// number of events used for initialization from data
+#define INIT_EVENTS 20000
+// in sampling mode, number of physics events for the pedestals of LMS channels
+#define INIT_SAMPLE_PHYSICS 2000
 
 class PRadHyCalSystem;
 class PRadGEMSystem;
@@ -37,6 +42,10 @@ public:
 
     // mode change
     void SetOnlineMode(const bool &mode);
+    // initialize from the monitor events sampled over the whole file instead
+    // of the first events in the file, it is off by default
+    void SetInitSampling(const bool &mode) {initSampling = mode;};
+    bool GetInitSampling() const {return initSampling;};
 
     // set systems
     void SetHyCalSystem(PRadHyCalSystem *hycal) {hycal_sys = hycal;};
@@ -47,6 +56,10 @@ public:
     PRadGEMSystem *GetGEMSystem() const {return gem_sys;};
     PRadEPICSystem *GetEPICSystem() const {return epic_sys;};
 
+    // cache of the initialization from data, empty directory disables it
+    void SetCalibCacheDirectory(const std::string &dir) {calib_cache.SetDirectory(dir);};
+    const std::string &GetCalibCacheDirectory() const {return calib_cache.GetDirectory();};
+
     // file reading and writing
     void Decode(const void *buffer);
     void ReadFromDST(const std::string &path, unsigned int mode = 0);
@@ -71,6 +84,7 @@ public:
     void FeedData(const TDCV767Data &tdcData);
     void FeedData(const TDCV1190Data &tdcData);
     void FeedData(const GEMRawData &gemData);
+    void FeedData(const std::vector<GEMRawData> &gemData);
     void FeedData(const std::vector<GEMZeroSupData> &gemData);
     void FeedData(const EPICSRawData &epicsData);
 
@@ -90,6 +104,7 @@ public:
 
 private:
     void waitEventProcess();
+    void readSampledEvents(const std::string &path);
 
 private:
     PRadEvioParser parser;
@@ -98,8 +113,10 @@ private:
     PRadTaggerSystem *tagger_sys;
     PRadHyCalSystem *hycal_sys;
     PRadGEMSystem *gem_sys;
+    PRadCalibCache calib_cache;
     bool onlineMode;
     bool replayMode;
+    bool initSampling;
     int current_event;
     std::thread end_thread;
 
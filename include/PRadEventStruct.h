@@ -15,6 +15,10 @@
 #define FCUP_OFFSET 100.0
 #define FCUP_SLOPE 906.2
 
+// max number of time samples for a GEM strip, the zero suppressed data words
+// use 3 bits for the time sample
+#define GEM_MAX_TIME_SAMPLES 8
+
 //============================================================================//
 // *BEGIN* RUN INFORMATION STRUCTURE                                          //
 //============================================================================//
@@ -169,10 +173,51 @@ struct APVAddress
     {};
 };
 
+// time samples of a GEM strip, they are stored inline because there are only
+// a few of them, it can be used like a small std::vector<float>
+// values beyond the capacity are discarded
+struct GEMSamples
+{
+    uint32_t count;
+    float data[GEM_MAX_TIME_SAMPLES];
+
+    GEMSamples() : count(0) {};
+    GEMSamples(const std::vector<float> &vals) : count(0)
+    {
+        assign(vals.data(), vals.data() + vals.size());
+    }
+
+    void assign(const float *first, const float *last)
+    {
+        count = 0;
+        for(; first != last && count < GEM_MAX_TIME_SAMPLES; ++first)
+            data[count++] = *first;
+    }
+
+    void push_back(const float &v)
+    {
+        if(count < GEM_MAX_TIME_SAMPLES)
+            data[count++] = v;
+    }
+
+    void clear() {count = 0;};
+    uint32_t size() const {return count;};
+    bool empty() const {return count == 0;};
+    float *begin() {return data;};
+    float *end() {return data + count;};
+    const float *begin() const {return data;};
+    const float *end() const {return data + count;};
+    float &operator [](const uint32_t &i) {return data[i];};
+    const float &operator [](const uint32_t &i) const {return data[i];};
+
+    // conversion for the codes that work with std::vector
+    operator std::vector<float>() const {return std::vector<float>(begin(), end());};
+};
+
 struct GEM_Data
 {
     APVAddress addr;
-    std::vector<float> values;
+    GEMSamples values;
 
     GEM_Data() {};
     GEM_Data(const unsigned char &f,
@@ -2,6 +2,7 @@
 #define PRAD_EVIO_PARSER_H
 
 #include <fstream>
+#include <vector>
 #include <cstdint>
 #include "datastruct.h"
 #include "PRadException.h"
@@ -10,6 +11,19 @@ class PRadDataHandler;
 
 class PRadEvioParser
 {
+public:
+    // position of an event in the evio file and its trigger type
+    struct EventIndex
+    {
+        int64_t block;      // file position of the block
+        uint32_t offset;    // position of the event in the block (in words)
+        uint32_t trigger;   // trigger type from TI bank
+
+        EventIndex() : block(0), offset(0), trigger(NotFromTI) {};
+        EventIndex(int64_t b, uint32_t o, uint32_t t)
+        : block(b), offset(o), trigger(t) {};
+    };
+
 public:
     // constructor, destructor
     PRadEvioParser(PRadDataHandler* handler);
@@ -18,6 +32,8 @@ public:
     // public member functions
     void ReadEvioFile(const char *filepath, int evt = -1, bool verbose = false);
     int ReadEventBuffer(const void *buf);
+    int IndexEvioFile(const char *filepath, std::vector<EventIndex> &index, bool verbose = false);
+    int ReadEvioEvents(const char *filepath, const std::vector<EventIndex> &events, bool verbose = false);
 
     void SetHandler(PRadDataHandler *h) {myHandler = h;};
     void SetEventNumber(const unsigned int &ev) {event_number = ev;};
@@ -27,11 +43,15 @@ public:
     // static functions
     static PRadTriggerType bit_to_trigger(const unsigned int &bit);
     static unsigned int trigger_to_bit(const PRadTriggerType &trg);
+    static std::vector<EventIndex> sample_events(const std::vector<EventIndex> &index,
+                                                 const uint32_t &trg_mask,
+                                                 const size_t &num);
 
 private:
     // private member functions
     int parseEvioBlock(std::ifstream &s, uint32_t *buf, int max_evt) throw(PRadException);
     int parseEvent(const PRadEventHeader *evt_header);
+    uint32_t peekTrigger(const PRadEventHeader *evt_header);
     void parseROCBank(const PRadEventHeader *roc_header);
     void parseDataBank(const PRadEventHeader *data_header);
     void parseADC1881M(const uint32_t *data);
@@ -42,7 +62,8 @@ private:
     void parseDSCData(const uint32_t *data, const uint32_t &size);
     void parseTIData(const uint32_t *data, const uint32_t &size, const int &roc_id);
     void parseEPICS(const uint32_t *data);
-    uint32_t getAPVDataSize(const uint32_t *data);
+    uint32_t getAPVDataSize(const uint32_t *data, const uint32_t &size);
+    uint32_t findGEMMarker(const uint32_t *data, uint32_t begin, const uint32_t &size);
 
 private:
     PRadDataHandler *myHandler;
@@ -0,0 +1,92 @@
+#ifndef PRAD_FIT_DRIVER_H
+#define PRAD_FIT_DRIVER_H
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#ifdef MULTI_THREAD
+#include <thread>
+#include <atomic>
+#include <exception>
+#endif
+
+// runs independent fitting jobs on a pool of workers
+// a job is called as func(job_index, worker_index, message_stream), the worker
+// index should be used to pick the objects owned by that worker (e.g. TF1), the
+// jobs must not create functions by name (e.g. Fit("gaus")), the messages are
+// kept for each job and can be printed in the order of jobs
+// the parallel fits use Minuit2, the jobs run in one thread if it is not
+// available, an exception from a job is thrown again after all workers stop
+class PRadFitDriver
+{
+public:
+    // 0 means using all the available hardware threads
+    PRadFitDriver(unsigned int workers = 0);
+
+    unsigned int GetWorkers() const {return workers;};
+    void Flush(std::ostream &os = std::cout);
+
+    template<typename Func>
+    void Run(size_t njobs, Func &&func)
+    {
+        messages.clear();
+        messages.resize(njobs);
+
+#ifdef MULTI_THREAD
+        if(workers > 1 && njobs > 1) {
+            std::atomic<size_t> next(0);
+            std::vector<std::exception_ptr> errors(njobs);
+            auto work = [&] (unsigned int worker)
+                        {
+                            for(size_t job = next++; job < njobs; job = next++)
+                            {
+                                std::ostringstream os;
+                                try {
+                                    func(job, worker, os);
+                                } catch(...) {
+                                    errors[job] = std::current_exception();
+                                }
+                                messages[job] = os.str();
+                            }
+                        };
+
+            std::string minimizer = beginParallel();
+            std::vector<std::thread> pool;
+            for(unsigned int i = 1; i < workers; ++i)
+                pool.emplace_back(work, i);
+            work(0);
+
+            for(auto &thread : pool)
+                thread.join();
+            endParallel(minimizer);
+
+            for(auto &error : errors)
+            {
+                if(error)
+                    std::rethrow_exception(error);
+            }
+            return;
+        }
+#endif
+
+        for(size_t job = 0; job < njobs; ++job)
+        {
+            std::ostringstream os;
+            func(job, 0, os);
+            messages[job] = os.str();
+        }
+    }
+
+private:
+#ifdef MULTI_THREAD
+    std::string beginParallel();
+    void endParallel(const std::string &minimizer);
+#endif
+
+private:
+    unsigned int workers;
+    std::vector<std::string> messages;
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include <iostream>
 #include "PRadEventStruct.h"
 #include "datastruct.h"
+#include "PRadPedestalEstimator.h"
 
 //1 time sample data have 128 channel
 #define TIME_SAMPLE_SIZE 128
@@ -21,6 +22,7 @@
 class PRadGEMFEC;
 class PRadGEMPlane;
 class TH1I;
+class TF1;
 
 class PRadGEMAPV
 {
@@ -43,6 +45,10 @@ public:
     {
         unsigned char local;
         int plane;
+        // strip position and if the strip is used by the plane, they are
+        // from the plane geometry and stored here for the hit collection
+        float position;
+        bool valid;
     };
 
 public:
@@ -73,17 +79,17 @@ public:
     void ReleasePedHist();
     void FillPedHist();
     void ResetPedHist();
-    void FitPedestal();
+    void FitPedestal(const bool &fit_check = false, std::ostream &os = std::cout,
+                     TF1 *fit = nullptr);
     void FillRawData(const uint32_t *buf, const uint32_t &siz);
     void FillZeroSupData(const uint32_t &ch, const uint32_t &ts, const unsigned short &val);
     void FillZeroSupData(const uint32_t &ch, const std::vector<float> &vals);
+    void FillZeroSupData(const uint32_t &ch, const GEMSamples &vals);
     void SplitData(const uint32_t &buf, float &word1, float &word2);
     void UpdatePedestal(std::vector<Pedestal> &ped);
     void UpdatePedestal(const Pedestal &ped, const uint32_t &index);
     void UpdatePedestal(const float &offset, const float &noise, const uint32_t &index);
     void ZeroSuppression();
-    void CommonModeCorrection(float *buf, const uint32_t &size);
-    void CommonModeCorrection_Split(float *buf, const uint32_t &size);
     void CollectZeroSupHits(std::vector<GEM_Data> &hits);
     void CollectZeroSupHits();
     void ResetHitPos();
@@ -117,11 +123,12 @@ public:
     void UnsetFEC(bool force_unset = false);
     void SetDetectorPlane(PRadGEMPlane *p, int pl_idx, bool force_set = false);
     void UnsetDetectorPlane(bool force_unset = false);
+    void UpdateStripMap();
     void SetTimeSample(const uint32_t &t);
     void SetOrientation(const int &o) {orient = o;};
     void SetHeaderLevel(const int &h) {header_level = h;};
-    void SetCommonModeThresLevel(const float &t) {common_thres = t;};
-    void SetZeroSupThresLevel(const float &t) {zerosup_thres = t;};
+    void SetCommonModeThresLevel(const float &t) {common_thres = t; kernel_valid = false;};
+    void SetZeroSupThresLevel(const float &t) {zerosup_thres = t; kernel_valid = false;};
     void SetCrossTalkThresLevel(const float &t) {crosstalk_thres = t;};
 
 private:
@@ -129,6 +136,11 @@ private:
     void getAverage(float &ave, const float *buf, const uint32_t &set = 0);
     uint32_t getTimeSampleStart();
     void buildStripMap();
+    void addHit(const uint32_t &ch);
+    void sortHits();
+    void updateKernel();
+    void commonModeCorrection(float *buf, const uint32_t &ts, float *strip_sum);
+    float *stripData(const uint32_t &ch) const {return &strip_data[ch*ts_stride];};
 
 private:
     PRadGEMFEC *fec;
@@ -147,9 +159,27 @@ private:
     uint32_t buffer_size;
     uint32_t ts_index;
     float *raw_data;
+    // time samples of each strip after common mode correction, [strip][ts]
+    // the rows are padded to multiple of 4 samples
+    uint32_t ts_stride;
+    float *strip_data;
     Pedestal pedestal[TIME_SAMPLE_SIZE];
     StripNb strip_map[TIME_SAMPLE_SIZE];
     bool hit_pos[TIME_SAMPLE_SIZE];
+    // channels of the hit strips, so the hits can be collected and cleared
+    // without going through all the channels
+    uint32_t hit_count;
+    unsigned char hit_list[TIME_SAMPLE_SIZE];
+    // per channel tables for the zero suppression kernel, they are rebuilt
+    // from pedestal, strip map and thresholds once any of them is changed
+    bool kernel_valid;
+    float cm_offset[TIME_SAMPLE_SIZE];
+    float cm_thres[TIME_SAMPLE_SIZE];
+    float zs_thres[TIME_SAMPLE_SIZE];
+    int32_t cm_set[TIME_SAMPLE_SIZE];
+    PRadPedestalEstimator offset_est[TIME_SAMPLE_SIZE];
+    PRadPedestalEstimator noise_est[TIME_SAMPLE_SIZE];
+    // only used for cross check of the estimators
     TH1I *offset_hist[TIME_SAMPLE_SIZE];
     TH1I *noise_hist[TIME_SAMPLE_SIZE];
 };
@@ -20,17 +20,27 @@ public:
 
     void FormClusters(std::vector<StripHit> &hits,
                       std::vector<StripCluster> &clusters) const;
+    void Reconstruct(const std::vector<StripCluster> &x_cluster,
+                     const std::vector<StripCluster> &y_cluster,
+                     std::vector<GEMHit> &container) const;
     void CartesianReconstruct(const std::vector<StripCluster> &x_cluster,
                               const std::vector<StripCluster> &y_cluster,
                               std::vector<GEMHit> &container) const;
+    void ChargeMatchReconstruct(const std::vector<StripCluster> &x_cluster,
+                                const std::vector<StripCluster> &y_cluster,
+                                std::vector<GEMHit> &container) const;
 
 protected:
     void groupHits(std::vector<StripHit> &h, std::vector<StripCluster> &c) const;
+    void addConsecutiveHit(std::vector<StripCluster> &c, const StripHit &h,
+                           bool &new_cluster) const;
     void splitCluster(std::vector<StripCluster> &c) const;
-    bool splitCluster_sub(StripCluster &c, StripCluster &c1) const;
+    std::vector<StripHit>::iterator findValley(std::vector<StripHit>::iterator begin,
+                                               std::vector<StripHit>::iterator end) const;
     void filterCluster(std::vector<StripCluster> &c) const;
     bool filterCrossTalk(const StripCluster &cluster,
-                         const std::vector<StripCluster> &clusters) const;
+                         const std::vector<std::pair<float, uint32_t>> &positions,
+                         const std::vector<char> &removed) const;
     void reconstructCluster(std::vector<StripCluster> &c) const;
 
 protected:
@@ -40,6 +50,11 @@ protected:
     float split_cluster_diff;
     float cross_talk_width;
 
+    // x, y cluster pairing
+    bool charge_match;
+    float charge_asym_cut;
+    unsigned int max_cluster_pairs;
+
     // cross talk characteristic distances
     std::vector<double> charac_distance;
 };
@@ -48,6 +48,7 @@ public:
     uint32_t GetCapacity() const {return adc_list.size();};
     PRadGEMAPV *GetAPV(const int &slot) const;
     std::vector<PRadGEMAPV*> GetAPVList() const;
+    std::vector<GEM_Data> &GetHitBuffer() {return hit_buffer;};
 
     // functions apply to all apv members
     // functions apply to all apv members
@@ -67,6 +68,9 @@ private:
     int id;
     std::string ip;
     std::vector<PRadGEMAPV*> adc_list;
+    // zero suppressed hits of the current event, only the thread that decodes
+    // this FEC writes to it
+    std::vector<GEM_Data> hit_buffer;
 };
 
 #endif
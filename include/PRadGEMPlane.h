@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include "PRadVectorPool.h"
 
 // unit is mm
 // X plane did a shift to move the X origin to center hole
@@ -53,10 +54,14 @@ public:
     void DisconnectAPV(const uint32_t &plane_index, bool force_disconn);
     void DisconnectAPVs();
     void AddStripHit(const int &plane_strip, const std::vector<float> &charges, const bool &ct = false, const int &apv_id=-1);
+    void AddStripHit(const int &plane_strip, const float *charges, const uint32_t &size, const bool &ct = false, const int &apv_id=-1);
+    void AddStripHit(const int &plane_strip, const float &position, const float *charges, const uint32_t &size, const bool &ct, const int &apv_id);
     void ClearStripHits();
     void CollectAPVHits();
     float GetStripPosition(const int &plane_strip) const;
+    bool IsValidStrip(const int &plane_strip) const;
     float GetMaxCharge(const std::vector<float> &charges) const;
+    float GetMaxCharge(const float *charges, const uint32_t &size) const;
     float GetIntegratedCharge(const std::vector<float> &charges) const;
     void FormClusters(PRadGEMCluster *method);
 
@@ -64,9 +69,9 @@ public:
     void SetDetector(PRadGEMDetector *det, bool force_set = false);
     void UnsetDetector(bool force_unset = false);
     void SetName(const std::string &n) {name = n;};
-    void SetType(const PlaneType &t) {type = t;};
-    void SetSize(const float &s) {size = s;};
-    void SetOrientation(const int &o) {orient = o;};
+    void SetType(const PlaneType &t) {type = t; updateAPVStripMaps();};
+    void SetSize(const float &s) {size = s; updateAPVStripMaps();};
+    void SetOrientation(const int &o) {orient = o; updateAPVStripMaps();};
     void SetCapacity(int c);
 
     // get parameter
@@ -82,6 +87,9 @@ public:
     std::vector<StripCluster> &GetStripClusters() {return strip_clusters;};
     const std::vector<StripCluster> &GetStripClusters() const {return strip_clusters;};
 
+private:
+    void updateAPVStripMaps();
+
 private:
     PRadGEMDetector *detector;
     std::string name;
@@ -117,7 +125,7 @@ struct StripCluster
     float position;
     float peak_charge;
     float total_charge;
-    std::vector<StripHit> hits;
+    PRadPooledVector<StripHit> hits;
 
     StripCluster()
     : position(0.), peak_charge(0.), total_charge(0.)
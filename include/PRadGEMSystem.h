@@ -13,15 +13,12 @@
 #include "PRadGEMCluster.h"
 #include "ConfigObject.h"
 
-#ifdef MULTI_THREAD
-#include <thread>
-#include <mutex>
-#endif
-
 // fec id should be consecutive from 0
 // enlarge this value if there are more FECs
 #define MAX_FEC_ID 128
 
+class PRadTaskPool;
+
 class PRadGEMSystem : public ConfigObject
 {
 public:
@@ -57,8 +54,10 @@ public:
     void RebuildDetectorMap();
     void RebuildDAQMap();
     void FillRawData(const GEMRawData &raw, EventData &event);
+    void FillRawData(const std::vector<GEMRawData> &frames, EventData &event);
     void FillZeroSupData(const std::vector<GEMZeroSupData> &data_pack, EventData &event);
     void FillZeroSupData(const GEMZeroSupData &data);
+    void MergeHits(EventData &event);
     bool Register(PRadGEMDetector *det);
     bool Register(PRadGEMFEC *fec);
 
@@ -66,12 +65,14 @@ public:
     void SetUnivZeroSupThresLevel(const float &thres);
     void SetUnivTimeSample(const uint32_t &thres);
     void SetPedestalMode(const bool &m);
+    void SetAPVDecodeThreads(unsigned int t);
     void FitPedestal();
     void Reset();
     void SavePedestal(const std::string &path) const;
     void SaveHistograms(const std::string &path) const;
 
     PRadGEMCluster *GetClusterMethod() const {return gem_recon;};
+    unsigned int GetAPVDecodeThreads() const;
     PRadGEMDetector *GetDetector(const int &id) const;
     PRadGEMDetector *GetDetector(const std::string &name) const;
     PRadGEMFEC *GetFEC(const int &id) const;
@@ -93,6 +94,10 @@ private:
 private:
     PRadGEMCluster *gem_recon;
     bool PedestalMode;
+    bool PedestalFitCheck;
+    // workers for decoding the APVs of a GEM bank in parallel, null means
+    // the APVs are decoded one by one
+    PRadTaskPool *apv_pool;
     std::vector<PRadGEMDetector*> det_list;
     std::vector<PRadGEMFEC*> fec_list;
 
@@ -107,10 +112,6 @@ private:
 
     // cross talk threshold
     float def_ctth;
-
-#ifdef MULTI_THREAD
-    std::mutex locker;
-#endif
 };
 
 #endif
@@ -0,0 +1,95 @@
+#ifndef PRAD_HISTOGRAM_H
+#define PRAD_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+
+// alignment of the counter buffer, one cache line
+#define HIST_ALIGNMENT 64
+
+class TH1;
+
+class PRadHistogram
+{
+public:
+    typedef std::atomic<unsigned int> Counter;
+
+public:
+    // constructor, it takes the ownership of the ROOT histogram
+    PRadHistogram(TH1 *h, int shards = 1);
+
+    // copy/move constructors
+    PRadHistogram(const PRadHistogram &that);
+    PRadHistogram(PRadHistogram &&that);
+
+    // destructor
+    virtual ~PRadHistogram();
+
+    // copy/move assignment operators
+    PRadHistogram &operator =(const PRadHistogram &rhs);
+    PRadHistogram &operator =(PRadHistogram &&rhs);
+
+    // fill a count, lock-free and can be called from multiple threads
+    void Fill(const double &x)
+    {
+        add(find_bin(x, nbins_x, min_x, max_x));
+    }
+
+    void Fill(const double &x, const double &y)
+    {
+        add(find_bin(x, nbins_x, min_x, max_x)
+            + (nbins_x + 2)*find_bin(y, nbins_y, min_y, max_y));
+    }
+
+    void Reset();
+    unsigned int GetBinCount(int bin) const;
+    unsigned int GetEntries() const;
+    int GetShards() const {return shards;};
+    int GetDimension() const {return (nbins_y > 0) ? 2 : 1;};
+
+    // the ROOT histogram is only updated when it is requested
+    TH1 *GetHist() const;
+
+public:
+    // same bin definition as ROOT, 0 is underflow and nbins + 1 is overflow
+    static int find_bin(const double &val, int nbins, double min, double max)
+    {
+        if(val < min)
+            return 0;
+        if(!(val < max))
+            return nbins + 1;
+        return 1 + int(nbins*(val - min)/(max - min));
+    }
+
+private:
+    void reserve();
+    void release();
+    void sync() const;
+    static int thread_shard();
+
+    void add(int bin)
+    {
+        Counter *shard = counters;
+        if(shards > 1)
+            shard += (thread_shard()%shards)*stride;
+
+        shard[bin].fetch_add(1, std::memory_order_relaxed);
+        shard[nbins].fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    TH1 *hist;
+    int shards;
+    int nbins_x, nbins_y;
+    double min_x, max_x, min_y, max_y;
+    // number of bins include underflow and overflow bins
+    int nbins;
+    // counters of each shard, the last one is for entries
+    size_t stride;
+    unsigned char *buffer;
+    Counter *counters;
+    // entries when the ROOT histogram was updated, -1 means it needs update
+    mutable long long synced;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <unordered_map>
 #include "ConfigObject.h"
 #include "PRadEventStruct.h"
 #include "PRadHyCalDetector.h"
@@ -22,8 +23,10 @@ public:
                              std::vector<ModuleCluster> &clusters) const;
     virtual bool CheckCluster(const ModuleCluster &hit) const;
     virtual void LeakCorr(ModuleCluster &cluster, const std::vector<ModuleHit> &dead) const;
+    virtual void BuildModuleTables(const std::vector<PRadHyCalModule*> &mlist);
 
     void ReadVModuleList(const std::string &path);
+    void BuildVirtualNeighbors(const std::vector<PRadHyCalModule*> &mlist);
     float GetWeight(const float &E, const float &E0) const;
     float GetShowerDepth(int module_type, const float &E) const;
     void AddVirtHits(ModuleCluster &cluster, const std::vector<ModuleHit> &dead) const;
@@ -37,6 +40,8 @@ protected:
                  const ModuleHit &center,
                  const std::vector<ModuleHit> &hits) const;
     void reconstructPos(BaseHit *temp, int count, BaseHit *recon) const;
+    const std::vector<ModuleHit> &virtualNeighbors(const ModuleHit &center,
+                                                   bool inner) const;
 
 protected:
     bool depth_corr;
@@ -51,6 +56,11 @@ protected:
     unsigned int leak_iters;
     std::vector<ModuleHit> inner_virtual;
     std::vector<ModuleHit> outer_virtual;
+    // virtual modules that can be reached by the profile from a module, module
+    // id as key
+    bool virt_neighbors;
+    std::unordered_map<int, std::vector<ModuleHit>> inner_neighbors;
+    std::unordered_map<int, std::vector<ModuleHit>> outer_neighbors;
 };
 
 #endif
@@ -5,16 +5,27 @@
 #include <string>
 #include <iostream>
 #include <unordered_map>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include "PRadException.h"
 #include "PRadHyCalModule.h"
 #include "PRadDetector.h"
 #include "PRadEventStruct.h"
+#include "PRadVectorPool.h"
 
 
 // value to judge if two modules are connected at corner, quantized to module size
 #define CORNER_ADJACENT 1.5
 // value to judge if two modules are sharing a side line
 #define SIDE_ADJACENT 1.3
+// entries in the first chunk of the geometry table (in bits), each following
+// chunk doubles the size
+#define GEOMETRY_CHUNK_BITS 10
+// max number of chunks, it covers the whole index range
+#define GEOMETRY_MAX_CHUNKS 32
 
 class PRadHyCalSystem;
 class PRadHyCalCluster;
@@ -40,6 +51,40 @@ public:
         Max_Sector,
     };
 
+public:
+    // geometries of the modules, hits only keep the index to it, entry 0 is
+    // the default geometry, the geometries are stored as whole structures
+    // since the clustering reads several values of a hit together
+    // the table is shared by all the detectors and may be extended while the
+    // other threads are reading it (e.g. a module geometry is changed), so the
+    // entries are stored in chunks that are never moved or freed, the n-th
+    // chunk has 2^(GEOMETRY_CHUNK_BITS + n) entries, only Add takes the lock,
+    // the entries are never removed or modified
+    struct GeometryTable
+    {
+        GeometryTable();
+        ~GeometryTable();
+        unsigned int Add(const PRadHyCalModule::Geometry &geo);
+        PRadHyCalModule::Geometry Get(unsigned int idx) const;
+        size_t Size() const {return entries.load(std::memory_order_acquire);};
+
+        // no boundary check, idx must come from Add
+        const PRadHyCalModule::Geometry &At(unsigned int idx) const
+        {
+            uint64_t pos = (uint64_t)idx + (1ull << GEOMETRY_CHUNK_BITS);
+            int chunk = 63 - __builtin_clzll(pos) - GEOMETRY_CHUNK_BITS;
+            pos -= (1ull << (GEOMETRY_CHUNK_BITS + chunk));
+            return chunks[chunk].load(std::memory_order_acquire)[pos];
+        }
+
+    private:
+        typedef std::tuple<int, double, double, double, double, double, double> Key;
+        std::map<Key, unsigned int> index_map;
+        std::mutex locker;
+        std::atomic<unsigned int> entries;
+        std::atomic<PRadHyCalModule::Geometry*> chunks[GEOMETRY_MAX_CHUNKS];
+    };
+
 public:
     // constructor
     PRadHyCalDetector(const std::string &name = "HyCal", PRadHyCalSystem *sys = nullptr);
@@ -71,6 +116,7 @@ public:
     void DisconnectModule(const std::string &name, bool force_disconn = false);
     void DisconnectModule(PRadHyCalModule *module, bool force_disconn = false);
     void SortModuleList();
+    void UpdateModuleGrid();
     void ClearModuleList();
     void OutputModuleList(std::ostream &os) const;
     void Reset();
@@ -86,9 +132,12 @@ public:
     PRadHyCalModule *GetModule(const int &primex_id) const;
     PRadHyCalModule *GetModule(const std::string &module_name) const;
     PRadHyCalModule *GetModule(const float &x, const float &y) const;
+    template<class T>
+    void GetModules(const std::vector<T> &points, std::vector<PRadHyCalModule*> &modules) const;
     double GetEnergy() const;
     const std::vector<PRadHyCalModule*> &GetModuleList() const {return module_list;};
     const std::vector<ModuleHit> &GetModuleHits() const {return module_hits;};
+    const std::vector<ModuleHit> &GetDeadNeighbors(const int &id) const;
     const std::vector<ModuleCluster> &GetModuleClusters() const {return module_clusters;};
     std::vector<HyCalHit> &GetHits() {return hycal_hits;};
     const std::vector<HyCalHit> &GetHits() const {return hycal_hits;};
@@ -97,9 +146,17 @@ public:
     static int get_sector_id(const char *name);
     static const char *get_sector_name(int sec);
     static float hit_distance(const ModuleHit &m1, const ModuleHit &m2);
+    static unsigned int add_geometry(const PRadHyCalModule::Geometry &geo);
+    static const GeometryTable &get_geometry_table() {return geo_table;};
+
+protected:
+    static GeometryTable geo_table;
 
 protected:
     virtual void setLayout(PRadHyCalModule &module) const;
+    void buildModuleGrid();
+    void clearModuleGrid();
+    PRadHyCalModule *gridSearch(const float &x, const float &y) const;
 
 protected:
     PRadHyCalSystem *system;
@@ -108,53 +165,88 @@ protected:
     std::unordered_map<std::string, PRadHyCalModule*> name_map;
     std::vector<ModuleHit> module_hits;
     std::vector<ModuleHit> dead_hits;
+    // dead modules that can be reached by the profile from a module next to
+    // them, module id as key
+    std::unordered_map<int, std::vector<ModuleHit>> dead_neighbors;
     std::vector<ModuleCluster> module_clusters;
     std::vector<HyCalHit> hycal_hits;
+
+    // uniform grid to search module by position, cell size is the smallest
+    // module size, modules overlapping a cell are listed in module list order
+    double grid_x0;
+    double grid_y0;
+    double grid_step;
+    int grid_nx;
+    int grid_ny;
+    std::vector<unsigned int> grid_offset;
+    std::vector<PRadHyCalModule*> grid_modules;
 };
 
+// map a vector of points (any type with members x and y) to modules
+template<class T>
+void PRadHyCalDetector::GetModules(const std::vector<T> &points,
+                                   std::vector<PRadHyCalModule*> &modules)
+const
+{
+    modules.resize(points.size());
+    for(size_t i = 0; i < points.size(); ++i)
+        modules[i] = GetModule(points[i].x, points[i].y);
+}
+
+// compact hit, the geometry is looked up from the geometry table
 struct ModuleHit
 {
     int id;                         // module id
+    unsigned int geo_index;         // index in the geometry table
     unsigned int flag;              // module flag
     int sector;                     // hycal sector
-    PRadHyCalModule::Geometry geo;  // geometry
     float energy;                   // participated energy, may be splitted
     bool real;                      // false for virtual hit to correct leakage
 
     ModuleHit(bool r = true)
-    : id(0), flag(0), sector(0), energy(0), real(r)
+    : id(0), geo_index(0), flag(0), sector(0), energy(0), real(r)
     {};
 
     ModuleHit(PRadHyCalModule *m, float e, bool r = true)
     : energy(e), real(r)
     {
         id = m->GetID();
+        geo_index = m->GetGeometryIndex();
         flag = m->GetLayoutFlag();
         sector = m->GetSectorID();
-        geo = m->GetGeometry();
     };
 
+    // the accessors look up the table for every call, the code reading several
+    // values of a hit should get the geometry once
+    const PRadHyCalModule::Geometry &GetGeometry() const
+    {
+        return PRadHyCalDetector::get_geometry_table().At(geo_index);
+    }
+    int GetType() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).type;};
+    double GetX() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).x;};
+    double GetY() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).y;};
+    double GetZ() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).z;};
+    double GetSizeX() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).size_x;};
+    double GetSizeY() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).size_y;};
+    double GetSizeZ() const {return PRadHyCalDetector::get_geometry_table().At(geo_index).size_z;};
+
     bool operator ==(const ModuleHit &rhs) const {return id == rhs.id;};
 };
 
 struct ModuleCluster
 {
     ModuleHit center;               // center hit
-    std::vector<ModuleHit> hits;    // hits group
+    PRadPooledVector<ModuleHit> hits; // hits group
     float energy;                   // cluster energy
     float leakage;                  // energy leakage
 
     ModuleCluster()
     : energy(0), leakage(0)
-    {
-        hits.reserve(100);
-    }
+    {};
 
     ModuleCluster(const ModuleHit &hit)
     : center(hit), energy(0), leakage(0)
-    {
-        hits.reserve(100);
-    }
+    {};
 
     void AddHit(const ModuleHit &hit)
     {
@@ -86,7 +86,7 @@ public:
     void UnsetDetector(bool force_unset = false);
     void SetChannel(PRadADCChannel *ch, bool force_set = false);
     void UnsetChannel(bool force_unset = false);
-    void SetGeometry(const Geometry &geo) {geometry = geo;};
+    void SetGeometry(const Geometry &geo);
     void SetLayout(const Layout &lay) {layout = lay;};
     void SetLayoutFlag(unsigned int &flag) {layout.flag = flag;};
     void SetCalibConst(const PRadCalibConst &c) {cal_const = c;};
@@ -106,6 +106,7 @@ public:
     unsigned short GetID() const {return id;};
     const std::string &GetName() const {return name;};
     const Geometry &GetGeometry() const {return geometry;};
+    unsigned int GetGeometryIndex() const {return geo_index;};
     const Layout &GetLayout() const {return layout;};
     const PRadCalibConst &GetCalibConst() const {return cal_const;};
     PRadADCChannel *GetChannel() const {return daq_ch;};
@@ -149,6 +150,8 @@ protected:
     std::string name;
     int id;
     Geometry geometry;
+    // index in the geometry table of HyCal detector
+    unsigned int geo_index;
     Layout layout;
     PRadCalibConst cal_const;
 };
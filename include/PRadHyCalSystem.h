@@ -8,15 +8,13 @@
 #include "PRadHyCalCluster.h"
 #include "PRadSquareCluster.h"
 #include "PRadIslandCluster.h"
+#include "PRadPrimexCluster.h"
 #include "PRadClusterProfile.h"
 #include "PRadTDCChannel.h"
 #include "PRadADCChannel.h"
+#include "PRadHistogram.h"
 #include "ConfigObject.h"
 
-#ifdef USE_PRIMEX_METHOD
-#include "PRadPrimexCluster.h"
-#endif
-
 // adc searching speed is important, thus reserve buckets to have unordered_map
 // better formed
 #define ADC_BUCKETS 5000
@@ -39,8 +37,6 @@ namespace std
     };
 }
 
-class TH1D;
-
 class PRadHyCalSystem : public ConfigObject
 {
 public:
@@ -113,7 +109,7 @@ public:
     void FillEnergyHist(const double &e);
     void FillEnergyHist(const EventData &event);
     void ResetEnergyHist();
-    TH1 *GetEnergyHist() const {return energy_hist;};
+    TH1 *GetEnergyHist() const {return energy_hist->GetHist();};
     void SaveHists(const std::string &path) const;
     std::vector<double> FitHist(const std::string &channel,
                                 const std::string &hist_name,
@@ -124,11 +120,18 @@ public:
     void FitPedestal();
     void CorrectGainFactor(int ref);
 
+    // adc to energy conversion table
+    void UpdateEnergyTable();
+
+private:
+    double sumEnergy(const std::vector<ADC_Data> &adc_data) const;
 
 private:
     PRadHyCalDetector *hycal;
     PRadHyCalCluster *recon;
-    TH1D *energy_hist;
+    PRadHistogram *energy_hist;
+    // cross check the pedestal estimators with gaussian fits
+    bool ped_fit_check;
 
     // channel lists
     std::vector<PRadADCChannel*> adc_list;
@@ -140,6 +143,11 @@ private:
     std::unordered_map<ChannelAddress, PRadTDCChannel*> tdc_addr_map;
     std::unordered_map<std::string, PRadTDCChannel*> tdc_name_map;
 
+    // pedestal and gain of the adc channels, indexed by channel id
+    // it needs to be updated once pedestals or calibration constants change
+    std::vector<double> ch_ped;
+    std::vector<double> ch_gain;
+
     // clustering method map
     std::unordered_map<std::string, PRadHyCalCluster*> recon_map;
 };
@@ -25,7 +25,7 @@ protected:
     bool fillClusters(ModuleHit &hit, std::vector<std::vector<ModuleHit*>> &groups) const;
     bool checkAdjacent(const std::vector<ModuleHit*> &g1, const std::vector<ModuleHit*> &g2) const;
     void splitCluster(const std::vector<ModuleHit*> &grp, std::vector<ModuleCluster> &c) const;
-    std::vector<ModuleHit*> findMaximums(const std::vector<ModuleHit*> &g) const;
+    void findMaximums(const std::vector<ModuleHit*> &g, std::vector<ModuleHit*> &m) const;
     void splitHits(const std::vector<ModuleHit*> &maximums,
                    const std::vector<ModuleHit*> &hits,
                    std::vector<ModuleCluster> &clusters) const;
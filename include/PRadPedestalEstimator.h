@@ -0,0 +1,63 @@
+#ifndef PRAD_PEDESTAL_ESTIMATOR_H
+#define PRAD_PEDESTAL_ESTIMATOR_H
+
+#include <vector>
+#include <atomic>
+
+// number of values used to seed the estimator
+#define PED_EST_SEED_SIZE 32
+// values beyond this number of sigmas from the mean are rejected
+#define PED_EST_CLIP 5.0
+// lower limit of sigma used in rejection, values are from integer ADC counts
+#define PED_EST_MIN_SIGMA 1.0
+
+// the estimator is not thread safe, one estimator can only be filled by one
+// thread at a time, debug builds check it in Fill
+class PRadPedestalEstimator
+{
+public:
+    // constructor
+    PRadPedestalEstimator(double clip = PED_EST_CLIP,
+                          double min_sigma = PED_EST_MIN_SIGMA);
+
+    void Fill(const double &val);
+    void Reset();
+
+    unsigned int GetEntries() const;
+    unsigned int GetRejected() const {return rejected;};
+    double GetMean() const;
+    double GetSigma() const;
+    bool IsConsistent(const double &m, const double &s,
+                      double mean_tol = 0.5, double sigma_tol = 0.3) const;
+
+private:
+    void fill(const double &val);
+    void seed();
+    void update(const double &val);
+    bool accept(const double &val) const;
+
+private:
+    double clip;
+    double min_sigma;
+    // the first values are buffered to get a robust starting point from their
+    // median and median absolute deviation
+    std::vector<float> seeds;
+    bool seeded;
+    unsigned int count;
+    unsigned int rejected;
+    // running mean and sum of squared deviations
+    double mean;
+    double m2;
+
+    // set while a value is being filled, only used by the check in debug builds
+    struct FillFlag
+    {
+        std::atomic<bool> busy;
+
+        FillFlag() : busy(false) {};
+        FillFlag(const FillFlag &) : busy(false) {};
+        FillFlag &operator =(const FillFlag &) {return *this;};
+    } filling;
+};
+
+#endif
@@ -1,19 +1,17 @@
 #ifndef PRAD_PRIMEX_CLUSTER_H
 #define PRAD_PRIMEX_CLUSTER_H
 
-#include <map>
 #include <string>
 #include <vector>
 #include "PRadHyCalCluster.h"
+#include "PRadPrimexIsland.h"
 
 //this is a c++ wrapper around the primex island algorithm
 //used for HyCal cluster reconstruction
+//the island algorithm is done by the c++ port, the original fortran code is
+//only used to validate the port if USE_PRIMEX_METHOD is defined
 
 //define some global constants
-#define MSECT 5
-#define MCOL 34
-#define MROW 34
-
 #define CRYSTAL_BLOCKS 1156 // 34x34 array (2x2 hole in the center)
 #define GLASS_BLOCKS 900    // 30x30 array holes are also counted (18x18 in the center)
 #define BLANK_BLOCKS 100    // For simplifying indexes
@@ -21,7 +19,6 @@
 #define T_BLOCKS 2156
 
 #define MAX_HHITS 1728 // For Hycal
-#define MAX_CC 60
 
 #define nint_phot_cell  5
 #define ncoef_phot_cell 3
@@ -66,6 +63,7 @@ typedef struct
     float e;   // Energy of ADC
 } cluster_block_t;
 
+#ifdef USE_PRIMEX_METHOD
 extern "C"
 {
     void load_pwo_prof_(char* config_dir, int str_len);
@@ -128,9 +126,19 @@ extern "C"
     #define ISECT     set_common_.isect
     #define FA(N) hbk_common_.fa[N-1]
 }
+#endif
 
 class PRadPrimexCluster : public PRadHyCalCluster
 {
+public:
+    // hits of a sector, [column - 1][row - 1]
+    struct SectorHits
+    {
+        int count;
+        PRadPrimexIsland::Matrix ech;
+        const ModuleHit *hits[MCOL][MROW];
+    };
+
 public:
     PRadPrimexCluster(const std::string &path = "");
     virtual ~PRadPrimexCluster();
@@ -145,15 +153,23 @@ public:
     void LeakCorr(ModuleCluster &c, const std::vector<ModuleHit> &dead) const;
 
 private:
-    void callIsland(const std::vector<ModuleHit> &hits, int isect) const;
-    std::vector<ModuleCluster> getIslandResult(const std::map<int, ModuleHit*> &hmap) const;
+    void fillSectors(std::vector<ModuleHit> &hits, SectorHits *sect_hits) const;
+    void getIslandResult(const std::vector<PRadPrimexIsland::Gamma> &gammas,
+                         const SectorHits &sect_hits,
+                         std::vector<ModuleCluster> &res) const;
     void glueClusters(std::vector<ModuleCluster> &b, std::vector<ModuleCluster> &s) const;
     bool checkTransAdj(const ModuleCluster &c1, const ModuleCluster &c2) const;
+#ifdef USE_PRIMEX_METHOD
+    bool validateIsland(int isect, const SectorHits &sect_hits,
+                        const std::vector<PRadPrimexIsland::Gamma> &gammas) const;
+#endif
 
 private:
     float adj_dist;
+    bool validate;
     std::vector<float> min_module_energy;
     int module_status[MSECT][MCOL][MROW];
+    PRadPrimexIsland island;
 };
 
 #endif
@@ -0,0 +1,117 @@
+#ifndef PRAD_PRIMEX_ISLAND_H
+#define PRAD_PRIMEX_ISLAND_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+// dimensions of the sector matrix, same as island.F
+#define MSECT 5
+#define MCOL 34
+#define MROW 34
+// max number of cells saved for a gamma
+#define MAX_CC 60
+// max number of gammas from one sector
+#define MAX_GAMMAS 50
+// steps of the profile table in each direction
+#define ISLAND_PROF_STEPS 501
+
+// c++ port of the island algorithm in fortran/island.F
+// the fortran code keeps everything in COMMON blocks, here the profiles are
+// read-only after loading and all the working arrays live in a workspace that
+// belongs to the caller, so different sectors and events can be reconstructed
+// at the same time
+// the floating point operations follow the fortran code in single precision
+// and in the same order, so the results are the same as the fortran code
+class PRadPrimexIsland
+{
+public:
+    // sector settings, the set_common block in island.F
+    struct Sector
+    {
+        int isect;              // sector number, 0 for PbWO4
+        int ncol, nrow;         // number of columns and rows
+        float xsize, ysize;     // module sizes
+
+        Sector() : isect(0), ncol(0), nrow(0), xsize(0), ysize(0) {};
+        Sector(int s, int c, int r, float x, float y)
+        : isect(s), ncol(c), nrow(r), xsize(x), ysize(y) {};
+    };
+
+    // reconstructed gamma, the adcgam block and icl_common in island.F
+    struct Gamma
+    {
+        float energy;           // GeV
+        float x, y;             // cm, relative to the sector center
+        float chi2;
+        int type;               // cluster id after output, the same as fortran
+        int dime;               // number of cells in the cluster
+        int id;                 // 0 for one peak, 90 for the first step and
+                                // 10 for the second step of several peaks
+        int status;             // peak type
+        int nhits;              // number of saved cells, no more than MAX_CC
+        int index[MAX_CC];      // cell address, 100*column + row
+        int iener[MAX_CC];      // cell energy in 0.1 MeV
+
+        Gamma() : energy(0), x(0), y(0), chi2(0), type(0), dime(0), id(0), status(0), nhits(0) {};
+    };
+
+    // working arrays, they can be reused between calls to save the allocations
+    struct Workspace
+    {
+        std::vector<int> ia, id, lencl;
+        std::vector<int> iwrk, idp;
+        std::vector<float> fwrk;
+        std::vector<int> iaz;
+        std::vector<char> mark;
+        std::vector<Gamma> pre_gammas;
+    };
+
+    // energy in 0.1 MeV or status of the modules, [column - 1][row - 1]
+    typedef int Matrix[MCOL][MROW];
+
+public:
+    PRadPrimexIsland();
+
+    void LoadProfile(int type, const std::string &path);
+    bool HasProfile(int type) const;
+    void Reconstruct(const Sector &sect, const Matrix &ech, const Matrix &stat,
+                     std::vector<Gamma> &gammas, Workspace &ws) const;
+
+private:
+    // one cluster
+    void clusterHits(Workspace &ws, int nw) const;
+    void gamsCluster(const Sector &sect, const Matrix &stat, int nadc, int *ia, int *id,
+                     std::vector<Gamma> &gammas, Workspace &ws) const;
+    void gammaFit(const Sector &sect, const Matrix &stat, int nadc,
+                  const int *ia, const int *id, float &chisq,
+                  float &e1, float &x1, float &y1, Workspace &ws) const;
+    int fillZeros(const Sector &sect, const Matrix &stat, int nadc, const int *ia,
+                  Workspace &ws) const;
+    void mom1(const Sector &sect, int nadc, const int *ia, const int *id,
+              int nzero, const int *iaz, float &a0, float &x0, float &y0) const;
+    float chisq1(const Sector &sect, int nadc, const int *ia, const int *id,
+                 int nzero, const int *iaz, float e1, float x1, float y1) const;
+    float sigma2(const Sector &sect, float dx, float dy, float fc, float e) const;
+    int peakType(const Sector &sect, int ix, int iy) const;
+    void output(const Sector &sect, std::vector<Gamma> &gammas) const;
+
+    // energy fraction and its derivative squared, bilinear interpolation
+    float cell(const Sector &sect, float x, float y) const
+    {
+        return interp(acell[(sect.isect < 1) ? 0 : 1], x, y, 0.);
+    }
+    float d2c(const Sector &sect, float x, float y) const
+    {
+        return interp(ad2c[(sect.isect < 1) ? 0 : 1], x, y, 1.);
+    }
+    static float interp(const std::shared_ptr<const std::vector<float>> &table,
+                        float x, float y, float out_range);
+
+private:
+    // shared by the copies, a new table is created when it is reloaded
+    std::shared_ptr<const std::vector<float>> acell[2];
+    std::shared_ptr<const std::vector<float>> ad2c[2];
+};
+
+#endif
@@ -13,8 +13,11 @@ public:
     void Configure(const std::string &path);
     void FormCluster(std::vector<ModuleHit> &hits,
                      std::vector<ModuleCluster> &clusters) const;
+    void BuildModuleTables(const std::vector<PRadHyCalModule*> &mlist);
 
 protected:
+    void buildSeedTable(const std::vector<PRadHyCalModule*> &mlist);
+    void clearSeedTable();
     void groupHits(std::vector<ModuleHit> &hits,
                    std::vector<ModuleCluster> &clusters) const;
     bool fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &clusters) const;
@@ -22,10 +25,23 @@ protected:
                   std::vector<ModuleCluster> &clusters,
                   std::vector<unsigned int> &indices) const;
     bool checkBelongs(const ModuleHit &center, const ModuleHit &hit, float factor) const;
+    bool isIndexed(const ModuleHit &hit) const
+    {
+        return ((unsigned int)hit.id < seed_geo.size()) &&
+               (seed_geo[hit.id] == hit.geo_index);
+    }
 
 protected:
     // parameters for reconstruction
     unsigned int square_size;
+
+    // modules covered by the square of each module, in the same layout as
+    // the module grid of HyCal detector, module id as index
+    // geometry index of the module is saved to check if the table still
+    // describes the hit
+    std::vector<unsigned int> seed_geo;
+    std::vector<unsigned int> cover_offset;
+    std::vector<int> cover_modules;
 };
 
 #endif
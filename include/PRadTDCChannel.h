@@ -5,6 +5,7 @@
 #include <string>
 #include <unordered_map>
 #include "PRadDAQChannel.h"
+#include "PRadHistogram.h"
 
 class PRadADCChannel;
 class TH1;
@@ -38,14 +39,14 @@ public:
     void ClearTimeMeasure();
 
     PRadADCChannel* GetADCChannel(int id) const;
-    TH1 *GetHist() const {return tdc_hist;};
+    TH1 *GetHist() const {return tdc_hist ? tdc_hist->GetHist() : nullptr;};
     std::vector<PRadADCChannel*> GetChannelList() const;
     const std::vector<unsigned short> &GetTimeMeasure() const {return time_measure;};
 
 private:
     std::unordered_map<int, PRadADCChannel*> group_map;
     std::vector<unsigned short> time_measure;
-    TH1 *tdc_hist;
+    PRadHistogram *tdc_hist;
 };
 
 #endif
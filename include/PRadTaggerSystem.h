@@ -3,6 +3,7 @@
 
 #include "PRadEventStruct.h"
 #include "datastruct.h"
+#include "PRadHistogram.h"
 
 #define TAGGER_CHANID 30000 // Tagger tdc id will start from this number
 #define TAGGER_T_CHANID 1000 // Start from TAGGER_CHANID, more than 1000 will be t channel
@@ -33,12 +34,12 @@ public:
     void FillHists(const EventData &event);
 
     // get hists
-    TH2I *GetECounterHist() const {return hist_E;};
-    TH2I *GetTCounterHist() const {return hist_T;};
+    TH2I *GetECounterHist() const;
+    TH2I *GetTCounterHist() const;
 
 private:
-    TH2I *hist_E;
-    TH2I *hist_T;
+    PRadHistogram *hist_E;
+    PRadHistogram *hist_T;
 };
 
 #endif
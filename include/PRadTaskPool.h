@@ -0,0 +1,59 @@
+#ifndef PRAD_TASK_POOL_H
+#define PRAD_TASK_POOL_H
+
+#include <vector>
+#include <functional>
+#ifdef MULTI_THREAD
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#endif
+
+// a pool of persistent worker threads for short batches of independent jobs
+// the workers wait between the batches, so it is cheap enough to be used for
+// every event, a job is called as func(job_index), the calling thread also
+// works on the batch and Run returns when all the jobs are done
+// only one batch runs at a time, a Run from another thread during a batch does
+// the jobs by itself instead of waiting
+class PRadTaskPool
+{
+public:
+    // total number of threads including the calling one, 0 means using all
+    // the available hardware threads
+    PRadTaskPool(unsigned int threads = 0);
+    virtual ~PRadTaskPool();
+
+    // the worker threads cannot be copied or moved
+    PRadTaskPool(const PRadTaskPool &that) = delete;
+    PRadTaskPool(PRadTaskPool &&that) = delete;
+    PRadTaskPool &operator =(const PRadTaskPool &rhs) = delete;
+    PRadTaskPool &operator =(PRadTaskPool &&rhs) = delete;
+
+    unsigned int GetThreads() const {return nthreads;};
+    void Run(size_t njobs, const std::function<void(size_t)> &func);
+
+private:
+#ifdef MULTI_THREAD
+    void workerLoop();
+    void doJobs();
+#endif
+
+private:
+    unsigned int nthreads;
+#ifdef MULTI_THREAD
+    std::vector<std::thread> workers;
+    std::mutex run_locker;
+    std::mutex locker;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const std::function<void(size_t)> *task;
+    size_t task_jobs;
+    std::atomic<size_t> next_job;
+    unsigned int active;
+    unsigned long batch;
+    bool stop;
+#endif
+};
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef PRAD_VECTOR_POOL_H
+#define PRAD_VECTOR_POOL_H
+
+#include <vector>
+
+// max number of buffers kept by the pool of each thread
+#define VECTOR_POOL_SIZE 1024
+
+// per-thread pool of vector buffers
+// the containers created and destroyed in every event release their memory
+// here and acquire it back in the next event, so the reconstruction does not
+// allocate once the buffers are large enough
+template<typename T>
+class PRadVectorPool
+{
+public:
+    // get an empty vector, it reuses a released buffer if there is any
+    static std::vector<T> Acquire()
+    {
+        PRadVectorPool *pool = threadPool();
+        if(!pool || pool->buffers.empty())
+            return std::vector<T>();
+
+        std::vector<T> vec(std::move(pool->buffers.back()));
+        pool->buffers.pop_back();
+        return vec;
+    }
+
+    // give the buffer of the vector back to the pool, the vector becomes empty
+    // it does not throw, so it can be used in destructors, the buffer is just
+    // freed with the vector if the pool is full
+    static void Release(std::vector<T> &vec) noexcept
+    {
+        vec.clear();
+        if(vec.capacity() == 0)
+            return;
+
+        // the pool storage is reserved, so adding a buffer never reallocates
+        PRadVectorPool *pool = threadPool();
+        if(!pool || pool->buffers.size() >= pool->buffers.capacity())
+            return;
+
+        pool->buffers.emplace_back(std::move(vec));
+        vec.clear();
+    }
+
+    // free the buffers kept for the calling thread
+    static void Clear()
+    {
+        PRadVectorPool *pool = threadPool();
+        if(pool)
+            std::vector<std::vector<T>>().swap(pool->buffers);
+    }
+
+private:
+    PRadVectorPool(bool *flag) noexcept
+    : destroyed(flag)
+    {
+        // without the reserved storage the pool only drops the buffers
+        try {
+            buffers.reserve(VECTOR_POOL_SIZE);
+        } catch(...) {
+        }
+    }
+    ~PRadVectorPool() {*destroyed = true;};
+
+    // the pool of a thread is destroyed before the static objects, the
+    // containers released after that just free their memory
+    static PRadVectorPool *threadPool() noexcept
+    {
+        static thread_local bool pool_destroyed = false;
+        if(pool_destroyed)
+            return nullptr;
+
+        static thread_local PRadVectorPool pool(&pool_destroyed);
+        return &pool;
+    }
+
+private:
+    bool *destroyed;
+    std::vector<std::vector<T>> buffers;
+};
+
+// vector that takes its memory from the pool of the thread and gives it back
+// upon destruction, so the containers of each event reuse it
+// the moves only pass the buffer and do not throw, so the containers holding
+// it are moved instead of copied when they reallocate
+template<typename T>
+class PRadPooledVector : public std::vector<T>
+{
+public:
+    PRadPooledVector()
+    : std::vector<T>(PRadVectorPool<T>::Acquire())
+    {};
+
+    PRadPooledVector(const std::vector<T> &that)
+    : std::vector<T>(PRadVectorPool<T>::Acquire())
+    {
+        this->assign(that.begin(), that.end());
+    }
+
+    PRadPooledVector(std::vector<T> &&that) noexcept
+    : std::vector<T>(std::move(that))
+    {};
+
+    PRadPooledVector(const PRadPooledVector &that)
+    : PRadPooledVector(static_cast<const std::vector<T>&>(that))
+    {};
+
+    PRadPooledVector(PRadPooledVector &&that) noexcept
+    : std::vector<T>(std::move(that))
+    {};
+
+    ~PRadPooledVector()
+    {
+        PRadVectorPool<T>::Release(*this);
+    }
+
+    PRadPooledVector &operator =(const std::vector<T> &rhs)
+    {
+        if(this != &rhs)
+            this->assign(rhs.begin(), rhs.end());
+        return *this;
+    }
+
+    PRadPooledVector &operator =(std::vector<T> &&rhs) noexcept
+    {
+        if(this != &rhs) {
+            PRadVectorPool<T>::Release(*this);
+            std::vector<T>::operator =(std::move(rhs));
+        }
+        return *this;
+    }
+
+    PRadPooledVector &operator =(const PRadPooledVector &rhs)
+    {
+        return operator =(static_cast<const std::vector<T>&>(rhs));
+    }
+
+    PRadPooledVector &operator =(PRadPooledVector &&rhs) noexcept
+    {
+        return operator =(static_cast<std::vector<T>&&>(rhs));
+    }
+};
+
+#endif
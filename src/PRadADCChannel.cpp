@@ -20,7 +20,8 @@
 // constructor
 PRadADCChannel::PRadADCChannel(const std::string &name, const ChannelAddress &daqAddr)
 : PRadDAQChannel(name, daqAddr),
-  module(nullptr), tdc_group(nullptr), occupancy(0), sparsify(0), adc_value(0)
+  module(nullptr), tdc_group(nullptr), occupancy(0), sparsify(0), adc_value(0),
+  ped_hist(nullptr)
 {
     // initialize histograms
     trg_hist.resize(MAX_Trigger, nullptr);
@@ -52,18 +53,27 @@ PRadADCChannel::PRadADCChannel(const std::string &name, const ChannelAddress &da
 PRadADCChannel::PRadADCChannel(const PRadADCChannel &that)
 : PRadDAQChannel(that),
   module(nullptr), tdc_group(nullptr), pedestal(that.pedestal),
-  occupancy(that.occupancy), sparsify(that.sparsify), adc_value(that.adc_value)
+  occupancy(that.occupancy), sparsify(that.sparsify), adc_value(that.adc_value),
+  ped_hist(nullptr), ped_est(that.ped_est)
 {
     for(auto &it : that.hist_map)
     {
-        hist_map[it.first] = (TH1*) it.second->Clone();
+        hist_map[it.first] = new PRadHistogram(*it.second);
+        if(it.second == that.ped_hist)
+            ped_hist = hist_map[it.first];
     }
 
     trg_hist.resize(that.trg_hist.size(), nullptr);
     for(size_t i = 0; i < that.trg_hist.size(); ++i)
     {
-        if(that.trg_hist[i] != nullptr)
-            MapHist(that.trg_hist[i]->GetTitle(), i);
+        if(that.trg_hist[i] == nullptr)
+            continue;
+
+        for(auto &it : that.hist_map)
+        {
+            if(it.second == that.trg_hist[i])
+                trg_hist[i] = hist_map[it.first];
+        }
     }
 }
 
@@ -72,9 +82,10 @@ PRadADCChannel::PRadADCChannel(PRadADCChannel &&that)
 : PRadDAQChannel(that),
   module(nullptr), tdc_group(nullptr), pedestal(that.pedestal),
   occupancy(that.occupancy), sparsify(that.sparsify), adc_value(that.adc_value),
-  trg_hist(std::move(that.trg_hist)), hist_map(std::move(that.hist_map))
+  trg_hist(std::move(that.trg_hist)), hist_map(std::move(that.hist_map)),
+  ped_hist(that.ped_hist), ped_est(that.ped_est)
 {
-    // place holder
+    that.ped_hist = nullptr;
 }
 
 // destructor
@@ -111,8 +122,11 @@ PRadADCChannel &PRadADCChannel::operator =(PRadADCChannel &&rhs)
     occupancy = rhs.occupancy;
     sparsify = rhs.sparsify;
     adc_value = rhs.adc_value;
-    hist_map = std::move(hist_map);
-    trg_hist = std::move(trg_hist);
+    hist_map = std::move(rhs.hist_map);
+    trg_hist = std::move(rhs.trg_hist);
+    ped_hist = rhs.ped_hist;
+    rhs.ped_hist = nullptr;
+    ped_est = rhs.ped_est;
 
     return *this;
 }
@@ -185,7 +199,9 @@ bool PRadADCChannel::AddHist(const std::string &n, TH1 *hist)
                   << std::endl;
         return false;
     }
-    hist_map[key] = hist;
+    hist_map[key] = new PRadHistogram(hist);
+    if(key == "pedestal")
+        ped_hist = hist_map[key];
     return true;
 
 }
@@ -196,12 +212,12 @@ bool PRadADCChannel::MapHist(const std::string &name, int trg)
     if((size_t)trg >= trg_hist.size())
         return false;
 
-    TH1 *hist = GetHist(name);
-    if(hist == nullptr)
+    auto it = hist_map.find(ConfigParser::str_lower(name));
+    if(it == hist_map.end())
         return false;
 
     size_t index = (size_t) trg;
-    trg_hist[index] = hist;
+    trg_hist[index] = it->second;
 
     return true;
 }
@@ -214,7 +230,7 @@ const
     if(it == hist_map.end()) {
         return nullptr;
     }
-    return it->second;
+    return it->second->GetHist();
 }
 
 // get the histogram list
@@ -225,7 +241,7 @@ const
 
     for(auto &it : hist_map)
     {
-        hlist.push_back(it.second);
+        hlist.push_back(it.second->GetHist());
     }
 
     return hlist;
@@ -261,6 +277,8 @@ void PRadADCChannel::ResetHists()
         if(it.second)
             it.second->Reset();
     }
+
+    ped_est.Reset();
 }
 
 // erase histograms
@@ -270,6 +288,7 @@ void PRadADCChannel::ClearHists()
         delete it.second;
 
     hist_map.clear();
+    ped_hist = nullptr;
 
     for(auto &hist : trg_hist)
         hist = nullptr;
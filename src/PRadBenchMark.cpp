@@ -7,6 +7,70 @@
 
 #include "PRadBenchMark.h"
 
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// count the calls to the global operator new
+static std::atomic<uint64_t> __bm_alloc_count(0);
+
+void *operator new(size_t size)
+{
+    __bm_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    void *ptr = std::malloc(size ? size : 1);
+    if(!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    __bm_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
 
 
 PRadBenchMark::PRadBenchMark()
@@ -22,6 +86,7 @@ PRadBenchMark::~PRadBenchMark()
 void PRadBenchMark::Reset()
 {
     time_point = std::chrono::high_resolution_clock::now();
+    alloc_count = GetAllocationCount();
 }
 
 unsigned int PRadBenchMark::GetElapsedTime()
@@ -31,3 +96,29 @@ const
     auto int_ms = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_point);
     return int_ms.count();
 }
+
+// number of heap allocations since the last reset
+uint64_t PRadBenchMark::GetAllocations()
+const
+{
+    return GetAllocationCount() - alloc_count;
+}
+
+bool PRadBenchMark::IsCountingAllocations()
+{
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// total number of heap allocations of the process
+uint64_t PRadBenchMark::GetAllocationCount()
+{
+#ifdef COUNT_ALLOCATIONS
+    return __bm_alloc_count.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,341 @@
+//============================================================================//
+// Cache of the calibration constants obtained from the data of a run         //
+// The binary cache file starts with a header that identifies the data file   //
+// (size and modification time) and the inputs of the systems (hash of the    //
+// configurations, channel lists and base calibration constants), the file    //
+// is ignored and will be overwritten if any of them changes                  //
+//============================================================================//
+
+#include "PRadCalibCache.h"
+#include "PRadHyCalSystem.h"
+#include "PRadGEMSystem.h"
+#include "PRadADCChannel.h"
+#include "PRadHyCalModule.h"
+#include "PRadGEMAPV.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+// "PRCC" in file
+#define CALIB_CACHE_MAGIC 0x43435250
+
+
+
+//============================================================================//
+// Hash helpers                                                               //
+//============================================================================//
+
+// 64 bit FNV-1a hash
+class __cc_hasher
+{
+public:
+    __cc_hasher() : value(14695981039346656037ULL) {};
+
+    void add(const void *data, size_t size)
+    {
+        const unsigned char *p = static_cast<const unsigned char*>(data);
+        for(size_t i = 0; i < size; ++i)
+        {
+            value ^= p[i];
+            value *= 1099511628211ULL;
+        }
+    }
+
+    template<typename T>
+    void add(const T &val) {add(&val, sizeof(val));};
+
+    void add(const std::string &str)
+    {
+        add(str.data(), str.size());
+        // separator, so the boundaries of strings matter
+        add('\0');
+    }
+
+    uint64_t value;
+};
+
+// the key list is from a hash map, sort it so the order is fixed
+inline void __cc_hash_config(__cc_hasher &hasher, const ConfigObject &conf)
+{
+    hasher.add(conf.GetConfigPath());
+
+    std::vector<std::string> keys = conf.GetKeyList();
+    std::sort(keys.begin(), keys.end());
+
+    for(auto &key : keys)
+    {
+        hasher.add(key);
+        hasher.add(conf.GetConfigValue(key).String());
+    }
+}
+
+
+
+//============================================================================//
+// Constructor                                                                //
+//============================================================================//
+
+PRadCalibCache::PRadCalibCache(const std::string &dir)
+: directory(dir)
+{
+    // place holder
+}
+
+
+
+//============================================================================//
+// Public Member Functions                                                    //
+//============================================================================//
+
+// get the path to the cache file of a run
+std::string PRadCalibCache::GetCachePath(int run)
+const
+{
+    return directory + "/prad_" + std::to_string(run) + ".calib";
+}
+
+// load the cache of the run and apply it to the systems
+// return false if the cache does not exist or does not match the inputs, the
+// systems are not changed in that case
+bool PRadCalibCache::Load(const std::string &data_path, int run, int ref, bool sampling,
+                          PRadHyCalSystem *hycal, PRadGEMSystem *gem)
+const
+{
+    if(!IsEnabled() || !hycal || !gem)
+        return false;
+
+    Header expect;
+    if(!makeHeader(expect, data_path, run, ref, sampling, hycal, gem))
+        return false;
+
+    std::ifstream in(GetCachePath(run), std::ios::binary);
+    if(!in.is_open())
+        return false;
+
+    Header header;
+    in.read((char*) &header, sizeof(header));
+    if(!in ||
+       header.magic != expect.magic ||
+       header.version != expect.version ||
+       header.run != expect.run ||
+       header.ref != expect.ref ||
+       header.sampling != expect.sampling ||
+       header.file_size != expect.file_size ||
+       header.file_time != expect.file_time ||
+       header.input_hash != expect.input_hash) {
+        std::cout << "PRad Calib Cache: Cache for run " << run
+                  << " is outdated, it will be updated."
+                  << std::endl;
+        return false;
+    }
+
+    // read everything before touching the systems
+    const auto &adc_list = hycal->GetADCList();
+    uint32_t ch_size = 0;
+    in.read((char*) &ch_size, sizeof(ch_size));
+    if(in && ch_size != adc_list.size()) {
+        std::cout << "PRad Calib Cache: Cache for run " << run
+                  << " has " << ch_size << " HyCal channels while "
+                  << adc_list.size() << " are expected, it will be updated."
+                  << std::endl;
+        return false;
+    }
+
+    std::vector<PRadADCChannel::Pedestal> peds(ch_size);
+    std::vector<double> factors(ch_size);
+    for(uint32_t i = 0; i < ch_size; ++i)
+    {
+        in.read((char*) &peds[i], sizeof(peds[i]));
+        in.read((char*) &factors[i], sizeof(factors[i]));
+    }
+
+    std::vector<PRadGEMAPV*> apv_list = gem->GetAPVList();
+    uint32_t apv_size = 0;
+    in.read((char*) &apv_size, sizeof(apv_size));
+    if(in && apv_size != apv_list.size()) {
+        std::cout << "PRad Calib Cache: Cache for run " << run
+                  << " has " << apv_size << " GEM APVs while "
+                  << apv_list.size() << " are expected, it will be updated."
+                  << std::endl;
+        return false;
+    }
+
+    std::vector<PRadGEMAPV*> apvs(apv_size);
+    std::vector<std::vector<PRadGEMAPV::Pedestal>> apv_peds(apv_size);
+    for(uint32_t i = 0; i < apv_size && in; ++i)
+    {
+        GEMChannelAddress addr;
+        uint32_t ped_size = 0;
+        in.read((char*) &addr, sizeof(addr));
+        in.read((char*) &ped_size, sizeof(ped_size));
+        if(!in)
+            break;
+
+        apvs[i] = gem->GetAPV(addr);
+        apv_peds[i].resize(ped_size);
+        in.read((char*) apv_peds[i].data(), ped_size*sizeof(PRadGEMAPV::Pedestal));
+    }
+
+    if(!in) {
+        std::cerr << "PRad Calib Cache Error: Incomplete cache file "
+                  << "\"" << GetCachePath(run) << "\", it will be updated."
+                  << std::endl;
+        return false;
+    }
+
+    // apply the values
+    for(uint32_t i = 0; i < ch_size; ++i)
+    {
+        PRadADCChannel *channel = adc_list[i];
+        channel->SetPedestal(peds[i]);
+
+        PRadHyCalModule *module = channel->GetModule();
+        if(module) {
+            PRadCalibConst cal = module->GetCalibConst();
+            cal.factor = factors[i];
+            module->SetCalibConst(cal);
+        }
+    }
+    hycal->UpdateEnergyTable();
+
+    for(uint32_t i = 0; i < apv_size; ++i)
+    {
+        if(apvs[i])
+            apvs[i]->UpdatePedestal(apv_peds[i]);
+    }
+
+    return true;
+}
+
+// save the current calibration constants of the systems to the cache file
+bool PRadCalibCache::Save(const std::string &data_path, int run, int ref, bool sampling,
+                          const PRadHyCalSystem *hycal, const PRadGEMSystem *gem)
+const
+{
+    if(!IsEnabled() || !hycal || !gem)
+        return false;
+
+    Header header;
+    if(!makeHeader(header, data_path, run, ref, sampling, hycal, gem))
+        return false;
+
+    // the directory may already exist
+    mkdir(directory.c_str(), 0755);
+
+    // write to a temporary file first, so an interrupted writing does not
+    // leave a broken cache
+    std::string path = GetCachePath(run);
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if(!out.is_open()) {
+        std::cerr << "PRad Calib Cache Error: Cannot open file "
+                  << "\"" << tmp_path << "\", calibration cache is not saved."
+                  << std::endl;
+        return false;
+    }
+
+    out.write((char*) &header, sizeof(header));
+
+    const auto &adc_list = hycal->GetADCList();
+    uint32_t ch_size = adc_list.size();
+    out.write((char*) &ch_size, sizeof(ch_size));
+    for(auto channel : adc_list)
+    {
+        PRadADCChannel::Pedestal ped = channel->GetPedestal();
+        double factor = 0.;
+        if(channel->GetModule())
+            factor = channel->GetModule()->GetCalibConst().GetCalibConst();
+        out.write((char*) &ped, sizeof(ped));
+        out.write((char*) &factor, sizeof(factor));
+    }
+
+    std::vector<PRadGEMAPV*> apv_list = gem->GetAPVList();
+    uint32_t apv_size = apv_list.size();
+    out.write((char*) &apv_size, sizeof(apv_size));
+    for(auto apv : apv_list)
+    {
+        GEMChannelAddress addr = apv->GetAddress();
+        std::vector<PRadGEMAPV::Pedestal> ped_list = apv->GetPedestalList();
+        uint32_t ped_size = ped_list.size();
+        out.write((char*) &addr, sizeof(addr));
+        out.write((char*) &ped_size, sizeof(ped_size));
+        out.write((char*) ped_list.data(), ped_size*sizeof(PRadGEMAPV::Pedestal));
+    }
+
+    out.close();
+    if(!out || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "PRad Calib Cache Error: Failed to write file "
+                  << "\"" << path << "\", calibration cache is not saved."
+                  << std::endl;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// fill the header that identifies the data file and the inputs
+bool PRadCalibCache::makeHeader(Header &header, const std::string &data_path,
+                                int run, int ref, bool sampling,
+                                const PRadHyCalSystem *hycal,
+                                const PRadGEMSystem *gem)
+const
+{
+    struct stat file_stat;
+    if(stat(data_path.c_str(), &file_stat) != 0)
+        return false;
+
+    header.magic = CALIB_CACHE_MAGIC;
+    header.version = CALIB_CACHE_VERSION;
+    header.run = run;
+    header.ref = ref;
+    header.sampling = sampling;
+    header.file_size = file_stat.st_size;
+    header.file_time = file_stat.st_mtime;
+
+    __cc_hasher hasher;
+    __cc_hash_config(hasher, *hycal);
+    __cc_hash_config(hasher, *gem);
+
+    // channel list and the calibration constants before gain correction, they
+    // come from the files listed in the configuration, so the contents of
+    // these files are covered too
+    for(auto channel : hycal->GetADCList())
+    {
+        hasher.add(channel->GetName());
+        PRadHyCalModule *module = channel->GetModule();
+        if(!module) {
+            hasher.add(std::string());
+            continue;
+        }
+
+        const PRadCalibConst &cal = module->GetCalibConst();
+        hasher.add(module->GetName());
+        hasher.add(cal.GetBaseConst());
+        for(auto &gain : cal.GetRefGains())
+            hasher.add(gain);
+    }
+
+    // the pedestal estimation depends on the time samples and the common mode
+    // sets of each apv
+    for(auto apv : gem->GetAPVList())
+    {
+        GEMChannelAddress addr = apv->GetAddress();
+        hasher.add(addr.fec_id);
+        hasher.add(addr.adc_ch);
+        hasher.add(apv->GetNTimeSamples());
+        hasher.add(apv->GetSplitStatus());
+    }
+
+    header.input_hash = hasher.value;
+    return true;
+}
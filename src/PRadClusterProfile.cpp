@@ -9,10 +9,11 @@
 #include "PRadClusterProfile.h"
 #include "ConfigParser.h"
 #include <cmath>
+#include <algorithm>
 
 
-PRadClusterProfile::PRadClusterProfile(int t, int x, int y)
-: types(t), x_steps(x), y_steps(y)
+PRadClusterProfile::PRadClusterProfile(int t, int s)
+: types(t), steps(s), quantized(false), buffer(nullptr), trans_shift(32)
 {
     reserve();
 }
@@ -22,60 +23,65 @@ PRadClusterProfile::~PRadClusterProfile()
     release();
 }
 
+// allocate one aligned buffer for all the types
 void PRadClusterProfile::reserve()
 {
-    profiles = new Profile**[types];
-    for(int i = 0; i < types; ++i)
-    {
-        profiles[i] = new Profile*[x_steps];
-        for(int j = 0; j < x_steps; ++j)
-        {
-            profiles[i][j] = new Profile[y_steps];
-        }
-    }
+    type_size = (size_t)steps*(steps + 1)/2;
 
+    size_t elem_size = quantized ? sizeof(QProfile) : sizeof(Profile);
+    buffer_size = types*type_size*elem_size;
+    buffer = new unsigned char[buffer_size + PROFILE_ALIGNMENT];
+
+    // align the address
+    size_t offset = PROFILE_ALIGNMENT - (uintptr_t)buffer%PROFILE_ALIGNMENT;
+    profiles = reinterpret_cast<Profile*>(buffer + offset);
+    qprofiles = reinterpret_cast<QProfile*>(buffer + offset);
+
+    frac_scale.assign(types, 0.);
+    err_scale.assign(types, 0.);
+
+    Clear();
 }
 
 void PRadClusterProfile::release()
 {
-    if(!profiles)
-        return;
-
-    for(int i = 0; i < types; ++i)
-    {
-        for(int j = 0; j < x_steps; ++j)
-        {
-            delete [] profiles[i][j], profiles[i][j] = nullptr;
-        }
-        delete [] profiles[i], profiles[i] = nullptr;
-    }
-    delete [] profiles, profiles = nullptr;
-
-    types = 0;
-    x_steps = 0;
-    y_steps = 0;
+    delete [] buffer, buffer = nullptr;
+    profiles = nullptr;
+    qprofiles = nullptr;
+    buffer_size = 0;
 }
 
-void PRadClusterProfile::Resize(int t, int x, int y)
+void PRadClusterProfile::Resize(int t, int s)
 {
+    // the transition table depends on the range
+    ClearTransitionTable();
     release();
     types = t;
-    x_steps = x;
-    y_steps = y;
+    steps = s;
+    reserve();
+}
+
+// switch between float and 16 bit integer storage, profiles need to be
+// reloaded after the switch
+void PRadClusterProfile::SetQuantized(bool q)
+{
+    if(q == quantized)
+        return;
+
+    release();
+    quantized = q;
     reserve();
 }
 
 void PRadClusterProfile::Clear()
 {
-    for(int i = 0; i < types; ++i)
-    {
-        for(int j = 0; j < x_steps; ++j)
-        {
-            for(int k = 0; k < y_steps; ++k)
-            {
-                profiles[i][j][k] = Profile(0, 0);
-            }
-        }
+    size_t total = types*type_size;
+    if(quantized) {
+        for(size_t i = 0; i < total; ++i)
+            qprofiles[i] = QProfile(0, 0);
+    } else {
+        for(size_t i = 0; i < total; ++i)
+            profiles[i] = Profile(0, 0);
     }
 }
 
@@ -91,8 +97,6 @@ void PRadClusterProfile::LoadProfile(int type, const std::string &path)
         return;
     }
 
-    Profile **profile = profiles[type];
-
     ConfigParser parser;
     if(!parser.OpenFile(path)) {
         std::cerr << "PRad Cluster Profile Error: File"
@@ -102,6 +106,9 @@ void PRadClusterProfile::LoadProfile(int type, const std::string &path)
         return;
     }
 
+    // read the whole table first, the quantization needs the value ranges
+    std::vector<Profile> table(type_size);
+
     int x, y;
     float val, err;
     while(parser.ParseLine())
@@ -110,149 +117,314 @@ void PRadClusterProfile::LoadProfile(int type, const std::string &path)
             continue;
 
         parser >> x >> y >> val >> err;
-        if(x >= x_steps || y >= y_steps) {
+        if(x >= steps || y >= steps) {
             std::cout << "PRad Cluster Profile Warning: step "
                       << "(" << x << ", " << y << ") "
                       << "exceeds current capacity, only supports up to "
-                      << "(" << x_steps << ", " << y_steps << ")."
+                      << "(" << steps << ", " << steps << ")."
                       << std::endl;
             continue;
         }
         // x and y are symmetric
-        profile[x][y] = Profile(val, err);
-        profile[y][x] = Profile(val, err);
+        table[index(0, x, y)] = Profile(val, err);
     }
-}
 
-typedef PRadClusterProfile::Profile CProfile;
+    fill(type, table);
+}
 
-// 1 step has 0.01% difference, much smaller than the profiles' own error
-// so we are not going to do interpolation
-const CProfile &PRadClusterProfile::GetProfile(int type, int x, int y)
-const
+// fill the table of one type into the buffer
+void PRadClusterProfile::fill(int type, const std::vector<Profile> &table)
 {
-    if(x >= x_steps || y >= y_steps)
-        return empty_prof;
+    if(!quantized) {
+        Profile *dest = profiles + type*type_size;
+        for(size_t i = 0; i < type_size; ++i)
+            dest[i] = table[i];
+        return;
+    }
 
-    return profiles[type][x][y];
+    // scale the values to the full range of 16 bit integer
+    float max_frac = 0., max_err = 0.;
+    for(auto &prof : table)
+    {
+        if(prof.frac > max_frac)
+            max_frac = prof.frac;
+        if(prof.err > max_err)
+            max_err = prof.err;
+    }
+    frac_scale[type] = max_frac/UINT16_MAX;
+    err_scale[type] = max_err/UINT16_MAX;
+
+    auto quantize = [] (float val, float scale)
+                    {
+                        if(scale <= 0. || val <= 0.)
+                            return (uint16_t)0;
+                        return (uint16_t)(val/scale + 0.5);
+                    };
+
+    QProfile *dest = qprofiles + type*type_size;
+    for(size_t i = 0; i < type_size; ++i)
+    {
+        dest[i] = QProfile(quantize(table[i].frac, frac_scale[type]),
+                           quantize(table[i].err, err_scale[type]));
+    }
 }
 
+typedef PRadClusterProfile::Profile CProfile;
+
 // highly specific to HyCal geometry
 // TODO generalize it according to the module list read in
 #define PWO_X_BOUNDARY 353.09
 #define PWO_Y_BOUNDARY 352.75
-static float __cp_boundary[4] = {PWO_Y_BOUNDARY, PWO_X_BOUNDARY,
-                                 -PWO_Y_BOUNDARY, -PWO_X_BOUNDARY};
+static double __cp_boundary[4] = {PWO_Y_BOUNDARY, PWO_X_BOUNDARY,
+                                  -PWO_Y_BOUNDARY, -PWO_X_BOUNDARY};
 static bool __cp_x_boundary[4] = {false, true, false, true};
+// module sizes for a point in each type of region
+static double __cp_size_x[2] = {38.15, 20.77};
+static double __cp_size_y[2] = {38.15, 20.75};
+
+// quantized distance between two modules from different parts
+// the line connecting two modules crosses the boundary, the distance is the sum
+// of the two parts, each part quantized to the module's size (Moliere radius)
+static void __cp_trans_dist(const ModuleHit &m1, const ModuleHit &m2, int &dx, int &dy)
+{
+    // determine the line that connects the two points
+    // y = kx + b
+    const auto &g1 = m1.GetGeometry(), &g2 = m2.GetGeometry();
+    double k = (g2.y - g1.y)/(g2.x - g1.x);
+    double b = g1.y - k*g1.x;
+
+    // determine which boundary the line is crossing
+    int sect = abs(m1.sector - m2.sector);
+    double boundary = __cp_boundary[sect - 1];
+    bool x_boundary = __cp_x_boundary[sect - 1];
+
+    // get the intersect point
+    double inter_x, inter_y;
+    if(x_boundary) {
+        inter_x = boundary;
+        inter_y = k*inter_x + b;
+    } else {
+        inter_y = boundary;
+        inter_x = (inter_y - b)/k;
+    }
 
-const CProfile &PRadClusterProfile::GetProfile(const ModuleHit &m1, const ModuleHit &m2)
-const
+    dx = PRadClusterProfile::quantize(g1.x - inter_x, g1.size_x,
+                                      g2.x - inter_x, g2.size_x);
+    dy = PRadClusterProfile::quantize(g1.y - inter_y, g1.size_y,
+                                      g2.y - inter_y, g2.size_y);
+}
+
+// key of a transition module pair, pwo module id in the high bits
+inline uint32_t __cp_trans_key(const ModuleHit &m1, const ModuleHit &m2)
 {
+    if(m1.GetType() == PRadHyCalModule::PbWO4)
+        return ((uint32_t)m1.id << 16) | (uint32_t)m2.id;
+    return ((uint32_t)m2.id << 16) | (uint32_t)m1.id;
+}
+
+// multiplicative hash for the open addressing table
+inline uint32_t __cp_trans_hash(uint32_t key, int shift)
+{
+    return (key*2654435761u) >> shift;
+}
+
+// precompute the quantized distances between all the PbWO4-PbGlass module
+// pairs that are within the profile range
+void PRadClusterProfile::BuildTransitionTable(const std::vector<PRadHyCalModule*> &mlist)
+{
+    ClearTransitionTable();
+
+    std::vector<ModuleHit> pwo, lg;
+    for(auto &module : mlist)
+    {
+        // the key only has 16 bits for module id
+        if(module->GetID() >= (1 << 16))
+            continue;
+
+        if(module->IsLeadTungstate())
+            pwo.emplace_back(module, 0.);
+        else if(module->IsLeadGlass())
+            lg.emplace_back(module, 0.);
+        else
+            continue;
+
+        if((size_t)module->GetID() >= trans_geo.size())
+            trans_geo.resize(module->GetID() + 1, (unsigned int)-1);
+        trans_geo[module->GetID()] = module->GetGeometryIndex();
+    }
+
+    std::vector<TransPair> pairs;
     int dx, dy;
-    // both belong to the same part
-    if(m1.geo.type == m2.geo.type) {
-        dx = fabs(100.*(m1.geo.x - m2.geo.x)/m1.geo.size_x) + 0.5;
-        dy = fabs(100.*(m1.geo.y - m2.geo.y)/m1.geo.size_y) + 0.5;
-    // belong to different part
-    } else {
-        // determine the line that connects the two points
-        // y = kx + b
-        float k = (m2.geo.y - m1.geo.y)/(m2.geo.x - m1.geo.x);
-        float b = m1.geo.y - k*m1.geo.x;
-
-        // determine which boundary the line is crossing
-        int sect = abs(m1.sector - m2.sector);
-        float boundary = __cp_boundary[sect - 1];
-        bool x_boundary = __cp_x_boundary[sect - 1];
-
-        // get the intersect point
-        float inter_x, inter_y;
-        if(x_boundary) {
-            inter_x = boundary;
-            inter_y = k*inter_x + b;
-        } else {
-            inter_y = boundary;
-            inter_x = (inter_y - b)/k;
+    for(auto &m1 : pwo)
+    {
+        for(auto &m2 : lg)
+        {
+            __cp_trans_dist(m1, m2, dx, dy);
+            // out of range, the profile is 0 and it is not recorded
+            if(dx < 0 || dy < 0 || dx >= steps || dy >= steps)
+                continue;
+            pairs.emplace_back(__cp_trans_key(m1, m2), dx, dy);
         }
+    }
 
-        // the dx dy will be the sum of two parts, each part quantized to the
-        // module's size (Moliere radius)
-        dx =   fabs(100.*(m1.geo.x - inter_x)/m1.geo.size_x)
-             + fabs(100.*(m2.geo.x - inter_x)/m2.geo.size_x)
-             + 0.5;
-        dy =   fabs(100.*(m1.geo.y - inter_y)/m1.geo.size_y)
-             + fabs(100.*(m2.geo.y - inter_y)/m2.geo.size_y)
-             + 0.5;
+    // the table size is power of 2 and at most half filled
+    trans_shift = 31;
+    size_t size = 2;
+    while(size < 2*pairs.size() + 1)
+    {
+        size <<= 1;
+        --trans_shift;
     }
+    trans_table.assign(size, TransPair());
 
-    return GetProfile(m1.geo.type, dx, dy);
+    for(auto &pair : pairs)
+    {
+        uint32_t idx = __cp_trans_hash(pair.key, trans_shift);
+        while(trans_table[idx].key)
+            idx = (idx + 1) & (size - 1);
+        trans_table[idx] = pair;
+    }
 }
 
-static float __cp_size_x[2] = {38.15, 20.77};
-static float __cp_size_y[2] = {38.15, 20.75};
-inline int __cp_get_sector(const float &x, const float &y)
+void PRadClusterProfile::ClearTransitionTable()
 {
-    if(y > PWO_Y_BOUNDARY && x <= PWO_X_BOUNDARY)
-        return 1; // top
-
-    if(x > PWO_X_BOUNDARY && y > -PWO_X_BOUNDARY)
-        return 2; // right
-
-    if(y <= -PWO_Y_BOUNDARY && x > -PWO_X_BOUNDARY)
-        return 3; // bottom
+    trans_table.clear();
+    trans_geo.clear();
+    trans_shift = 32;
+}
 
-    if(x <= -PWO_X_BOUNDARY && y <= PWO_Y_BOUNDARY)
-        return 4; // left
+CProfile PRadClusterProfile::GetProfile(const ModuleHit &m1, const ModuleHit &m2)
+const
+{
+    const auto &g1 = m1.GetGeometry(), &g2 = m2.GetGeometry();
+    int dx, dy;
+    // both belong to the same part
+    if(g1.type == g2.type) {
+        dx = quantize(g1.x - g2.x, g1.size_x);
+        dy = quantize(g1.y - g2.y, g1.size_y);
+    // belong to different part, use the precomputed table if it describes both
+    } else if(isTransModule(m1) && isTransModule(m2)) {
+        uint32_t key = __cp_trans_key(m1, m2);
+        uint32_t mask = trans_table.size() - 1;
+        for(uint32_t idx = __cp_trans_hash(key, trans_shift);
+            trans_table[idx].key;
+            idx = (idx + 1) & mask)
+        {
+            if(trans_table[idx].key == key)
+                return GetProfile(g1.type, trans_table[idx].dx, trans_table[idx].dy);
+        }
+        // not in the table means out of range
+        return Profile();
+    // virtual modules, unknown modules or modules changed after the table
+    } else {
+        __cp_trans_dist(m1, m2, dx, dy);
+    }
 
-    return 0; // center
+    return GetProfile(g1.type, dx, dy);
 }
 
-const CProfile &PRadClusterProfile::GetProfile(const float &x, const float &y,
-                                               const ModuleHit &hit)
+CProfile PRadClusterProfile::GetProfile(const float &x, const float &y,
+                                        const ModuleHit &hit)
 const
 {
     // firstly, check which sector the point belongs to
     // 0 means pwo module and 1,2,3,4 means lg module
-    int sect = __cp_get_sector(x, y);
+    int sect = get_sector(x, y);
     int type = (sect == 0)? PRadHyCalModule::PbWO4 : PRadHyCalModule::PbGlass;
 
+    const auto &geo = hit.GetGeometry();
     int dx, dy;
     // both belong to the same part
-    if(type == hit.geo.type) {
-        dx = fabs(100.*(x - hit.geo.x)/hit.geo.size_x) + 0.5;
-        dy = fabs(100.*(y - hit.geo.y)/hit.geo.size_y) + 0.5;
+    if(type == geo.type) {
+        dx = quantize(x - geo.x, geo.size_x);
+        dy = quantize(y - geo.y, geo.size_y);
     // belong to different part
     } else {
-        // determine the line that connects the two points
-        float k = (y - hit.geo.y)/(x - hit.geo.x);
-        float b = y - k*x;
-
-        // determine which boundary the line is crossing
+        // the crossed boundary is known from the sectors, the distance along
+        // the boundary needs the intersect point, the other one does not
         sect = abs(sect - hit.sector);
-        float boundary = __cp_boundary[sect - 1];
-        bool x_boundary = __cp_x_boundary[sect - 1];
-
-        // get the intersect point
-        float inter_x, inter_y;
-        if(x_boundary) {
-            inter_x = boundary;
-            inter_y = k*inter_x + b;
+        double boundary = __cp_boundary[sect - 1];
+
+        double inter;
+        if(__cp_x_boundary[sect - 1]) {
+            inter = y + (geo.y - y)*(boundary - x)/(geo.x - x);
+            dx = quantize(x - boundary, __cp_size_x[type],
+                          geo.x - boundary, geo.size_x);
+            dy = quantize(y - inter, __cp_size_y[type],
+                          geo.y - inter, geo.size_y);
         } else {
-            inter_y = boundary;
-            inter_x = (inter_y - b)/k;
+            inter = x + (geo.x - x)*(boundary - y)/(geo.y - y);
+            dx = quantize(x - inter, __cp_size_x[type],
+                          geo.x - inter, geo.size_x);
+            dy = quantize(y - boundary, __cp_size_y[type],
+                          geo.y - boundary, geo.size_y);
         }
+    }
+
+    return GetProfile(geo.type, dx, dy);
+}
 
-        // the dx dy will be the sum of two parts, each part quantized to the
-        // module's size (Moliere radius)
-        dx =   fabs(100.*(x - inter_x)/__cp_size_x[type])
-             + fabs(100.*(hit.geo.x - inter_x)/hit.geo.size_x)
-             + 0.5;
-        dy =   fabs(100.*(y - inter_y)/__cp_size_y[type])
-             + fabs(100.*(hit.geo.y - inter_y)/hit.geo.size_y)
-             + 0.5;
+// gathered lookup of the fractions for n distances in the same type, it is the
+// same as calling GetProfile(type, x[i], y[i]).frac*scale for each of them
+// the indices are clamped into the table and the out of range ones are masked
+// to zero, so the loop has no branches, the output must not overlap the inputs
+// or the table (__restrict) so the compiler can use gathers for the float
+// table, there is no 16 bit gather so the quantized one stays scalar
+void PRadClusterProfile::GetFractions(int type,
+                                      const int *__restrict x,
+                                      const int *__restrict y,
+                                      size_t n, const float &scale,
+                                      float *__restrict frac)
+const
+{
+    // no table to clamp into
+    if(steps <= 0) {
+        std::fill(frac, frac + n, 0.f);
+        return;
     }
 
-    return GetProfile(hit.geo.type, dx, dy);
+    const unsigned int ns = steps, last = steps - 1;
+    const size_t base = type*type_size;
+    const float fscale = scale;
+
+    if(quantized) {
+        const QProfile *__restrict table = qprofiles + base;
+        const float qscale = frac_scale[type];
+        for(size_t i = 0; i < n; ++i)
+        {
+            unsigned int ux = x[i], uy = y[i];
+            float in = (ux < ns) & (uy < ns);
+            ux = std::min(ux, last);
+            uy = std::min(uy, last);
+            unsigned int lo = std::min(ux, uy), hi = std::max(ux, uy);
+            frac[i] = table[hi*(hi + 1)/2 + lo].frac*qscale*in*fscale;
+        }
+    } else {
+        const Profile *__restrict table = profiles + base;
+        for(size_t i = 0; i < n; ++i)
+        {
+            unsigned int ux = x[i], uy = y[i];
+            float in = (ux < ns) & (uy < ns);
+            ux = std::min(ux, last);
+            uy = std::min(uy, last);
+            unsigned int lo = std::min(ux, uy), hi = std::max(ux, uy);
+            frac[i] = table[hi*(hi + 1)/2 + lo].frac*in*fscale;
+        }
+    }
+}
+
+// check if the profile can be non-zero for the hit module, when the shower
+// position is reconstructed from the modules adjacent to the center module
+// max_size is the largest module size, which limits how far the reconstructed
+// position can be from the center, and how far the profile can reach
+bool PRadClusterProfile::IsInRange(const ModuleHit &center, const ModuleHit &hit,
+                                   const double &max_size)
+const
+{
+    double reach = (steps/100. + CORNER_ADJACENT)*max_size;
+
+    const auto &g1 = center.GetGeometry(), &g2 = hit.GetGeometry();
+    return (fabs(g1.x - g2.x) < reach) && (fabs(g1.y - g2.y) < reach);
 }
 
 // evaluate how well this cluster can be described by the profile
@@ -288,3 +460,21 @@ const
     return est/count;
 }
 
+// determine which sector the point belongs to
+// 0 means pwo module and 1,2,3,4 means lg module
+int PRadClusterProfile::get_sector(const float &x, const float &y)
+{
+    if(y > PWO_Y_BOUNDARY && x <= PWO_X_BOUNDARY)
+        return 1; // top
+
+    if(x > PWO_X_BOUNDARY && y > -PWO_X_BOUNDARY)
+        return 2; // right
+
+    if(y <= -PWO_Y_BOUNDARY && x > -PWO_X_BOUNDARY)
+        return 3; // bottom
+
+    if(x <= -PWO_X_BOUNDARY && y <= PWO_Y_BOUNDARY)
+        return 4; // left
+
+    return 0; // center
+}
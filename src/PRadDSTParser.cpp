@@ -239,6 +239,21 @@ throw(PRadException)
             readBuffer((char*) &value, sizeof(value));
             gemhit.add_value(value);
         }
+
+        // the hit cannot hold all the time samples, skip it instead of
+        // keeping a truncated one
+        if(value_size > GEM_MAX_TIME_SAMPLES) {
+            std::cerr << "DST Parser: GEM hit (FEC " << (int)gemhit.addr.fec
+                      << ", ADC " << (int)gemhit.addr.adc
+                      << ", strip " << (int)gemhit.addr.strip
+                      << ") in event " << data.event_number
+                      << " has " << value_size << " time samples, only "
+                      << GEM_MAX_TIME_SAMPLES << " are supported, "
+                      << "the hit is skipped."
+                      << std::endl;
+            continue;
+        }
+
         data.add_gemhit(gemhit);
     }
 
@@ -447,6 +462,8 @@ throw(PRadException)
         if(adc->GetModule() && TEST_BIT(mode, static_cast<uint32_t>(Mode::update_hycal_cal)))
             adc->GetModule()->SetCalibConst(cal);
     }
+    if(hycal)
+        hycal->UpdateEnergyTable();
 }
 
 void PRadDSTParser::WriteGEMInfo(const PRadGEMSystem *gem)
@@ -30,7 +30,7 @@
 PRadDataHandler::PRadDataHandler()
 : parser(this), dst_parser(this),
   epic_sys(nullptr), tagger_sys(nullptr), hycal_sys(nullptr), gem_sys(nullptr),
-  onlineMode(false), replayMode(false), current_event(0),
+  onlineMode(false), replayMode(false), initSampling(false), current_event(0),
   new_event(new EventData), proc_event(new EventData)
 {
     // place holder
@@ -40,7 +40,8 @@ PRadDataHandler::PRadDataHandler()
 PRadDataHandler::PRadDataHandler(const PRadDataHandler &that)
 : parser(this), dst_parser(this),
   epic_sys(nullptr), tagger_sys(nullptr), hycal_sys(nullptr), gem_sys(nullptr),
-  onlineMode(that.onlineMode), replayMode(that.replayMode),
+  calib_cache(that.calib_cache),
+  onlineMode(that.onlineMode), replayMode(that.replayMode), initSampling(that.initSampling),
   current_event(that.current_event), event_data(that.event_data),
   new_event(new EventData(*that.new_event)), proc_event(new EventData(*that.proc_event))
 {
@@ -50,7 +51,8 @@ PRadDataHandler::PRadDataHandler(const PRadDataHandler &that)
 PRadDataHandler::PRadDataHandler(PRadDataHandler &&that)
 : parser(this), dst_parser(this),
   epic_sys(nullptr), tagger_sys(nullptr), hycal_sys(nullptr), gem_sys(nullptr),
-  onlineMode(that.onlineMode), replayMode(that.replayMode),
+  calib_cache(that.calib_cache),
+  onlineMode(that.onlineMode), replayMode(that.replayMode), initSampling(that.initSampling),
   current_event(that.current_event), event_data(std::move(that.event_data)),
   new_event(new EventData(std::move(*that.new_event))),
   proc_event(new EventData(std::move(*that.proc_event)))
@@ -82,8 +84,10 @@ PRadDataHandler &PRadDataHandler::operator =(PRadDataHandler &&rhs)
     rhs.new_event = nullptr;
     proc_event = rhs.proc_event;
     rhs.proc_event = nullptr;
+    calib_cache = rhs.calib_cache;
     onlineMode = rhs.onlineMode;
     replayMode = rhs.replayMode;
+    initSampling = rhs.initSampling;
     current_event = rhs.current_event;
     event_data = std::move(rhs.event_data);
 
@@ -291,6 +295,13 @@ void PRadDataHandler::FeedData(const GEMRawData &gemData)
         gem_sys->FillRawData(gemData, *new_event);
 }
 
+// feed all the GEM data frames from one bank
+void PRadDataHandler::FeedData(const std::vector<GEMRawData> &gemData)
+{
+    if(gem_sys)
+        gem_sys->FillRawData(gemData, *new_event);
+}
+
 // feed GEM data which has been zero-suppressed
 void PRadDataHandler::FeedData(const std::vector<GEMZeroSupData> &gemData)
 {
@@ -319,6 +330,11 @@ void PRadDataHandler::FillHistograms(const EventData &data)
 void PRadDataHandler::EndofThisEvent(const unsigned int &ev)
 {
     new_event->event_number = ev;
+
+    // all the ROC banks are decoded, collect the GEM hits from FECs
+    if(gem_sys)
+        gem_sys->MergeHits(*new_event);
+
     // wait for the process thread
     waitEventProcess();
 
@@ -439,8 +455,25 @@ void PRadDataHandler::InitializeByData(const std::string &path, int ref)
 
     if(!path.empty()) {
         PRadInfoCenter::SetRunNumber(path);
+
+        // the same data file and inputs were used before, take the results
+        int run_number = PRadInfoCenter::GetRunNumber();
+        if(calib_cache.Load(path, run_number, ref, initSampling, hycal_sys, gem_sys)) {
+            Clear();
+            PRadInfoCenter::SetRunNumber(run_number);
+            std::cout << "Data Handler: Loaded calibration cache "
+                      << "\"" << calib_cache.GetCachePath(run_number) << "\", "
+                      << "took " << timer.GetElapsedTime()/1000. << " s"
+                      << std::endl;
+            return;
+        }
+
         gem_sys->SetPedestalMode(true);
-        parser.ReadEvioFile(path.c_str(), 20000);
+        if(initSampling)
+            readSampledEvents(path);
+        else
+            parser.ReadEvioFile(path.c_str(), INIT_EVENTS);
+        waitEventProcess();
     }
 
     std::cout << "Data Handler: Fitting Pedestal for HyCal." << std::endl;
@@ -460,11 +493,60 @@ void PRadDataHandler::InitializeByData(const std::string &path, int ref)
     Clear();
     PRadInfoCenter::SetRunNumber(run_number);
 
+    if(!path.empty() && calib_cache.Save(path, run_number, ref, initSampling, hycal_sys, gem_sys))
+        std::cout << "Data Handler: Saved calibration cache "
+                  << "\"" << calib_cache.GetCachePath(run_number) << "\"."
+                  << std::endl;
+
     std::cout << "Data Handler: Done initialization, took "
               << timer.GetElapsedTime()/1000. << " s"
               << std::endl;
 }
 
+// read the monitor events (LMS and Alpha) spread over the whole file, they are
+// what the pedestals and gain factors need, only the selected events are decoded
+// a small number of physics events are also taken for the LMS channels, whose
+// pedestals come from physics triggers
+void PRadDataHandler::readSampledEvents(const std::string &path)
+{
+    std::vector<PRadEvioParser::EventIndex> index;
+    if(!parser.IndexEvioFile(path.c_str(), index)) {
+        std::cerr << "Data Handler: Cannot index file "
+                  << "\"" << path << "\", read the first "
+                  << INIT_EVENTS << " events instead."
+                  << std::endl;
+        parser.ReadEvioFile(path.c_str(), INIT_EVENTS);
+        return;
+    }
+
+    uint32_t monitor = PRadEvioParser::trigger_to_bit(LMS_Led)
+                     | PRadEvioParser::trigger_to_bit(LMS_Alpha);
+    uint32_t physics = PRadEvioParser::trigger_to_bit(PHYS_LeadGlassSum)
+                     | PRadEvioParser::trigger_to_bit(PHYS_TotalSum)
+                     | PRadEvioParser::trigger_to_bit(PHYS_TaggerE)
+                     | PRadEvioParser::trigger_to_bit(PHYS_Scintillator);
+
+    auto events = PRadEvioParser::sample_events(index, monitor, INIT_EVENTS);
+    auto phys_events = PRadEvioParser::sample_events(index, physics, INIT_SAMPLE_PHYSICS);
+
+    // keep the file order so every block is read once
+    std::vector<PRadEvioParser::EventIndex> selected(events.size() + phys_events.size());
+    std::merge(events.begin(), events.end(), phys_events.begin(), phys_events.end(),
+               selected.begin(),
+               [] (const PRadEvioParser::EventIndex &a, const PRadEvioParser::EventIndex &b)
+               {
+                   return (a.block < b.block) ||
+                          ((a.block == b.block) && (a.offset < b.offset));
+               });
+
+    std::cout << "Data Handler: Sampled " << events.size() << " monitor events and "
+              << phys_events.size() << " physics events from "
+              << index.size() << " events."
+              << std::endl;
+
+    parser.ReadEvioEvents(path.c_str(), selected);
+}
+
 // find event by its event number
 // it is assumed the files decoded are all from 1 single run and they are loaded in order
 // otherwise this function will not work properly
@@ -11,12 +11,19 @@
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 
 #ifdef MULTI_THREAD
 #include <thread>
 #define ROC_THREAD_THRES 5000     // open a new thread for large roc buffer size
 #endif
 
+// the GEM frame markers are searched with SSE2 when it is available
+#if defined(__SSE2__) && !defined(GEM_SCALAR_SCAN)
+#define GEM_SSE2_SCAN
+#include <emmintrin.h>
+#endif
+
 #define MAX_BUFFER_SIZE 100000    // buffer to store a evio block
 #define BLOCK_HEADER_SIZE 8       // evio block header size
 
@@ -102,6 +109,113 @@ int PRadEvioParser::ReadEventBuffer(const void *buf)
     return parseEvent((const PRadEventHeader *)buf);
 }
 
+// go through the evio file and record the position and trigger type of every
+// event, the events are not decoded, return the number of indexed events
+int PRadEvioParser::IndexEvioFile(const char *filepath,
+                                  vector<EventIndex> &index,
+                                  bool verbose)
+{
+    index.clear();
+
+    ifstream evio_in(filepath, ios::binary | ios::in);
+
+    if(!evio_in.is_open()) {
+        cerr << "Cannot open evio file "
+             << "\"" << filepath << "\""
+             << endl;
+        return 0;
+    }
+
+    evio_in.seekg(0, evio_in.end);
+    int64_t length = evio_in.tellg();
+    evio_in.seekg(0, evio_in.beg);
+
+    uint32_t *buffer = new uint32_t[MAX_BUFFER_SIZE];
+
+    if(verbose) {
+        cout << "Indexing evio file " << filepath << endl;
+    }
+
+    int64_t pos;
+    while((pos = evio_in.tellg()) < length && pos != -1)
+    {
+        evio_in.read((char*) &buffer[0], sizeof(uint32_t));
+        if(!evio_in || buffer[0] > MAX_BUFFER_SIZE || buffer[0] < BLOCK_HEADER_SIZE) {
+            cerr << "Bad evio block at " << pos
+                 << ", stop indexing file " << filepath << endl;
+            break;
+        }
+
+        evio_in.read((char*) &buffer[1], sizeof(uint32_t)*(buffer[0] - 1));
+
+        for(uint32_t i = BLOCK_HEADER_SIZE; i < buffer[0]; i += buffer[i] + 1)
+        {
+            const PRadEventHeader *header = (const PRadEventHeader *) &buffer[i];
+            if(i + header->length >= buffer[0])
+                break;
+            // only the events from triggers
+            if(header->tag == CODA_Event)
+                index.emplace_back(pos, i, peekTrigger(header));
+        }
+    }
+
+    delete [] buffer;
+
+    return index.size();
+}
+
+// decode the events given by the index, they should be from the same file
+// and sorted by their positions, return the number of decoded events
+int PRadEvioParser::ReadEvioEvents(const char *filepath,
+                                   const vector<EventIndex> &events,
+                                   bool verbose)
+{
+    ifstream evio_in(filepath, ios::binary | ios::in);
+
+    if(!evio_in.is_open()) {
+        cerr << "Cannot open evio file "
+             << "\"" << filepath << "\""
+             << endl;
+        return 0;
+    }
+
+    if(verbose) {
+        cout << "Reading " << events.size() << " events from evio file "
+             << filepath << endl;
+    }
+
+    uint32_t *buffer = new uint32_t[MAX_BUFFER_SIZE];
+    int64_t block = -1;
+    int count = 0;
+
+    for(auto &event : events)
+    {
+        // read the block if it is a different one
+        if(event.block != block) {
+            block = -1;
+            evio_in.clear();
+            evio_in.seekg(event.block, evio_in.beg);
+            evio_in.read((char*) &buffer[0], sizeof(uint32_t));
+            if(!evio_in || buffer[0] > MAX_BUFFER_SIZE)
+                continue;
+            evio_in.read((char*) &buffer[1], sizeof(uint32_t)*(buffer[0] - 1));
+            if(!evio_in)
+                continue;
+            block = event.block;
+        }
+
+        if(event.offset >= buffer[0])
+            continue;
+
+        parseEvent((const PRadEventHeader *) &buffer[event.offset]);
+        count++;
+    }
+
+    delete [] buffer;
+
+    return count;
+}
+
 
 //============================================================================//
 // Private Member Functions                                                   //
@@ -206,6 +320,36 @@ int PRadEvioParser::parseEvent(const PRadEventHeader *header)
     return header->tag;
 }
 
+// find the trigger type of an event from its TI bank without decoding it
+uint32_t PRadEvioParser::peekTrigger(const PRadEventHeader *header)
+{
+    const uint32_t event_size = header->length - 1;
+    const uint32_t *buf = (const uint32_t*) &header[1];
+
+    for(uint32_t i = 0; i < event_size; i += buf[i] + 1)
+    {
+        const PRadEventHeader *roc_header = (const PRadEventHeader *) &buf[i];
+        const uint32_t roc_size = roc_header->length - 1;
+        const uint32_t *roc_buf = (const uint32_t*) &roc_header[1];
+
+        // banks are in ROC banks
+        if(roc_header->tag == EVINFO_BANK || roc_header->length < 1 ||
+           i + roc_header->length >= event_size)
+            continue;
+
+        for(uint32_t j = 0; j < roc_size; j += roc_buf[j] + 1)
+        {
+            const PRadEventHeader *data_header = (const PRadEventHeader *) &roc_buf[j];
+            if(j + data_header->length >= roc_size)
+                break;
+            if(data_header->tag == TI_BANK && data_header->length > 3)
+                return bit_to_trigger(roc_buf[j + 4]>>24);
+        }
+    }
+
+    return NotFromTI;
+}
+
 // parse ROC data
 void PRadEvioParser::parseROCBank(const PRadEventHeader *roc_header)
 {
@@ -337,24 +481,33 @@ void PRadEvioParser::parseGEMData(const uint32_t *data, const uint32_t &size,  c
     }
 
     // parse raw GEM data
+    // find all the APV frames first, so they can be decoded together
+    static thread_local vector<GEMRawData> gemFrames;
+    gemFrames.clear();
+
     GEMRawData gemData;
-    uint32_t i = 0;
+    uint32_t i = findGEMMarker(data, 0, size);
 
-    while(i < size)
+    while(i + 2 <= size)
     {
         if((data[i]&0xffffff00) == GEMDATA_APVBEG) {
             gemData.addr.adc_ch = data[i]&0xff;
             gemData.addr.fec_id = (data[i+1] >> 16)&0xff;
             gemData.buf = &data[i+2];
-            gemData.size = getAPVDataSize(gemData.buf);
+            gemData.size = getAPVDataSize(gemData.buf, size - i - 2);
 
-            myHandler->FeedData(gemData);
+            gemFrames.push_back(gemData);
 
             i += gemData.size;
         } else {
             ++i;
         }
+
+        // jump to the next frame
+        i = findGEMMarker(data, i, size);
     }
+
+    myHandler->FeedData(gemFrames);
 }
 
 // parse zero-suppressed GEM data
@@ -393,19 +546,46 @@ void PRadEvioParser::parseGEMZeroSupData(const uint32_t *data, const uint32_t &s
 }
 
 // a helper function to determine the APV data size
-uint32_t PRadEvioParser::getAPVDataSize(const uint32_t *data)
+// the frame ends before the next APV frame or at the end of FEC data
+uint32_t PRadEvioParser::getAPVDataSize(const uint32_t *data, const uint32_t &size)
 {
-    uint32_t idx = 0;
+    uint32_t idx = findGEMMarker(data, 0, size);
+
+    if(idx < size && data[idx] != GEMDATA_FECEND)
+        return idx - 1;
+
+    return idx;
+}
+
+// a helper function to find the first GEM APV header or FEC end word in
+// [begin, size), it returns size if there is none
+// the ADC words are 12 bits, so they never look like the markers
+uint32_t PRadEvioParser::findGEMMarker(const uint32_t *data, uint32_t begin, const uint32_t &size)
+{
+    uint32_t idx = begin;
+
+#ifdef GEM_SSE2_SCAN
+    const __m128i mask = _mm_set1_epi32(0xffffff00);
+    const __m128i apv_beg = _mm_set1_epi32(GEMDATA_APVBEG);
+    const __m128i fec_end = _mm_set1_epi32((int)GEMDATA_FECEND);
+    for(; idx + 4 <= size; idx += 4)
+    {
+        __m128i word = _mm_loadu_si128((const __m128i*)&data[idx]);
+        __m128i found = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(word, mask), apv_beg),
+                                     _mm_cmpeq_epi32(word, fec_end));
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(found));
+        if(bits)
+            return idx + __builtin_ctz(bits);
+    }
+#endif
 
-    while((data[idx]&0xffffff00) != GEMDATA_APVBEG)
+    for(; idx < size; ++idx)
     {
-        if(data[idx] == GEMDATA_FECEND) {
+        if(((data[idx]&0xffffff00) == GEMDATA_APVBEG) || (data[idx] == GEMDATA_FECEND))
             return idx;
-        }
-        ++idx;
     }
 
-    return idx - 1;
+    return size;
 }
 
 // parse CAEN V767 Data
@@ -565,3 +745,27 @@ unsigned int PRadEvioParser::trigger_to_bit(const PRadTriggerType &trg)
         return 1 << (int) trg;
 }
 
+// select num events with the trigger types in the mask from the index, the
+// selected events are evenly spread over the index and kept in order
+// trg_mask is the combination of trigger_to_bit(trigger)
+vector<PRadEvioParser::EventIndex> PRadEvioParser::sample_events(const vector<EventIndex> &index,
+                                                                 const uint32_t &trg_mask,
+                                                                 const size_t &num)
+{
+    vector<EventIndex> candidates, res;
+    for(auto &event : index)
+    {
+        if(trigger_to_bit((PRadTriggerType)event.trigger) & trg_mask)
+            candidates.push_back(event);
+    }
+
+    if(candidates.size() <= num)
+        return candidates;
+
+    res.reserve(num);
+    for(size_t i = 0; i < num; ++i)
+        res.push_back(candidates[i*candidates.size()/num]);
+
+    return res;
+}
+
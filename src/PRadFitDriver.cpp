@@ -0,0 +1,70 @@
+//============================================================================//
+// A simple driver that spreads independent fits over several threads        //
+// Each worker should use its own fitting objects, the results and messages   //
+// are collected by job index, so the output does not depend on the number   //
+// of workers                                                                 //
+//============================================================================//
+
+#include "PRadFitDriver.h"
+#ifdef MULTI_THREAD
+#include "TROOT.h"
+#include "Math/Factory.h"
+#include "Math/Minimizer.h"
+#include "Math/MinimizerOptions.h"
+#endif
+
+
+
+PRadFitDriver::PRadFitDriver(unsigned int w)
+: workers(1)
+{
+#ifdef MULTI_THREAD
+    workers = (w > 0) ? w : std::thread::hardware_concurrency();
+    if(workers < 1)
+        workers = 1;
+
+    // ROOT needs to be informed before being used in several threads
+    // the default minimizer (TMinuit) shares one global instance, only Minuit2
+    // can fit in several threads, it is loaded here so the workers do not
+    // need to load the plugin
+    if(workers > 1) {
+        ROOT::EnableThreadSafety();
+        ROOT::Math::Minimizer *minimizer = ROOT::Math::Factory::CreateMinimizer("Minuit2");
+        if(minimizer) {
+            delete minimizer;
+        } else {
+            std::cerr << "PRad Fit Driver Warning: Minuit2 is not available, "
+                      << "the fits will run in one thread."
+                      << std::endl;
+            workers = 1;
+        }
+    }
+#else
+    (void) w;
+#endif
+}
+
+// print out the messages in the order of jobs
+void PRadFitDriver::Flush(std::ostream &os)
+{
+    for(auto &msg : messages)
+        os << msg;
+
+    messages.clear();
+}
+
+#ifdef MULTI_THREAD
+// switch the default minimizer to Minuit2 for the parallel fits, the previous
+// one is returned so it can be restored
+std::string PRadFitDriver::beginParallel()
+{
+    std::string minimizer = ROOT::Math::MinimizerOptions::DefaultMinimizerType();
+    ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+    return minimizer;
+}
+
+void PRadFitDriver::endParallel(const std::string &minimizer)
+{
+    ROOT::Math::MinimizerOptions::SetDefaultMinimizer(minimizer.c_str());
+}
+#endif
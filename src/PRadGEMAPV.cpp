@@ -8,12 +8,21 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cmath>
 #include "PRadGEMFEC.h"
 #include "PRadGEMPlane.h"
 #include "PRadGEMAPV.h"
 #include "TF1.h"
 #include "TH1.h"
 
+// the zero suppression kernel uses SSE2 when it is available, define
+// APV_SCALAR_KERNEL to use the scalar loops instead, both give the same results
+#if defined(__SSE2__) && !defined(APV_SCALAR_KERNEL)
+#define APV_SSE2_KERNEL
+#include <emmintrin.h>
+#endif
+
 
 
 //============================================================================//
@@ -35,6 +44,7 @@ PRadGEMAPV::PRadGEMAPV(const int &o,
     initialize();
 
     raw_data = nullptr;
+    strip_data = nullptr;
     SetTimeSample(t);
 
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
@@ -63,6 +73,9 @@ void PRadGEMAPV::initialize()
     // these can only be assigned by a Plane (SetDetectorPlane)
     plane = nullptr;
     plane_index = -1;
+
+    // kernel tables will be built from the pedestal when they are needed
+    kernel_valid = false;
 }
 
 // The copy and move constructor/assignment operator won't copy or replace the
@@ -87,12 +100,23 @@ PRadGEMAPV::PRadGEMAPV(const PRadGEMAPV &that)
         raw_data[i] = that.raw_data[i];
     }
 
+    ts_stride = that.ts_stride;
+    strip_data = new float[TIME_SAMPLE_SIZE*ts_stride];
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE*ts_stride; ++i)
+    {
+        strip_data[i] = that.strip_data[i];
+    }
+
     // copy other arrays
+    hit_count = that.hit_count;
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
         pedestal[i] = that.pedestal[i];
         strip_map[i] = that.strip_map[i];
         hit_pos[i] = that.hit_pos[i];
+        hit_list[i] = that.hit_list[i];
+        offset_est[i] = that.offset_est[i];
+        noise_est[i] = that.noise_est[i];
 
         // dangerous part, may fail due to lack of memory
         if(that.offset_hist[i] != nullptr) {
@@ -122,17 +146,25 @@ PRadGEMAPV::PRadGEMAPV(PRadGEMAPV &&that)
     buffer_size = that.buffer_size;
     ts_index = that.ts_index;
     raw_data = that.raw_data;
+    ts_stride = that.ts_stride;
+    strip_data = that.strip_data;
     // null the pointer of that
     that.buffer_size = 0;
     that.raw_data = nullptr;
+    that.ts_stride = 0;
+    that.strip_data = nullptr;
 
     // other arrays
     // static array, so no need to move, just copy elements
+    hit_count = that.hit_count;
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
         pedestal[i] = that.pedestal[i];
         strip_map[i] = that.strip_map[i];
         hit_pos[i] = that.hit_pos[i];
+        hit_list[i] = that.hit_list[i];
+        offset_est[i] = that.offset_est[i];
+        noise_est[i] = that.noise_est[i];
 
         // these need to be moved
         offset_hist[i] = that.offset_hist[i];
@@ -150,6 +182,7 @@ PRadGEMAPV::~PRadGEMAPV()
     ReleasePedHist();
 
     delete[] raw_data;
+    delete[] strip_data;
 }
 
 // copy assignment operator
@@ -166,6 +199,7 @@ PRadGEMAPV &PRadGEMAPV::operator= (PRadGEMAPV &&rhs)
     // release memory
     ReleasePedHist();
     delete[] raw_data;
+    delete[] strip_data;
 
     // members
     time_samples = rhs.time_samples;
@@ -175,22 +209,31 @@ PRadGEMAPV &PRadGEMAPV::operator= (PRadGEMAPV &&rhs)
     common_thres = rhs.common_thres;
     zerosup_thres = rhs.zerosup_thres;
     crosstalk_thres = rhs.crosstalk_thres;
+    kernel_valid = false;
 
     // raw_data related
     buffer_size = rhs.buffer_size;
     ts_index = rhs.ts_index;
     raw_data = rhs.raw_data;
+    ts_stride = rhs.ts_stride;
+    strip_data = rhs.strip_data;
     // null the pointer of that
     rhs.buffer_size = 0;
     rhs.raw_data = nullptr;
+    rhs.ts_stride = 0;
+    rhs.strip_data = nullptr;
 
     // other arrays
     // static array, so no need to move, just copy elements
+    hit_count = rhs.hit_count;
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
         pedestal[i] = rhs.pedestal[i];
         strip_map[i] = rhs.strip_map[i];
         hit_pos[i] = rhs.hit_pos[i];
+        hit_list[i] = rhs.hit_list[i];
+        offset_est[i] = rhs.offset_est[i];
+        noise_est[i] = rhs.noise_est[i];
 
         // these need to be moved
         offset_hist[i] = rhs.offset_hist[i];
@@ -268,7 +311,7 @@ void PRadGEMAPV::UnsetDetectorPlane(bool force_unset)
     plane_index = -1;
 }
 
-// create histograms
+// create histograms, they are only needed to cross check the estimators
 void PRadGEMAPV::CreatePedHist()
 {
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
@@ -288,10 +331,14 @@ void PRadGEMAPV::CreatePedHist()
     }
 }
 
+// reset pedestal estimators and histograms
 void PRadGEMAPV::ResetPedHist()
 {
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
+        offset_est[i].Reset();
+        noise_est[i].Reset();
+
         if(offset_hist[i])
             offset_hist[i]->Reset();
         if(noise_hist[i])
@@ -309,16 +356,29 @@ void PRadGEMAPV::ReleasePedHist()
     }
 }
 
-// set time samples and reserve memory for raw data
+// set time samples and reserve memory for raw data and strip data
 void PRadGEMAPV::SetTimeSample(const uint32_t &t)
 {
-    time_samples = t;
-    buffer_size = t*TIME_SAMPLE_DIFF + APV_EXTEND_SIZE;
+    // strip hits keep their time samples in a fixed size array
+    if(t > GEM_MAX_TIME_SAMPLES) {
+        std::cerr << "GEM APV Error: APV " << fec_id << ", " << adc_ch
+                  << " is set to have " << t << " time samples, but only "
+                  << GEM_MAX_TIME_SAMPLES << " are supported."
+                  << std::endl;
+        time_samples = GEM_MAX_TIME_SAMPLES;
+    } else {
+        time_samples = t;
+    }
+
+    buffer_size = time_samples*TIME_SAMPLE_DIFF + APV_EXTEND_SIZE;
+    ts_stride = (time_samples + 3)/4*4;
 
     // reallocate the memory for proper size
     delete[] raw_data;
+    delete[] strip_data;
 
     raw_data = new float[buffer_size];
+    strip_data = new float[TIME_SAMPLE_SIZE*ts_stride];
 
     ClearData();
 }
@@ -330,14 +390,20 @@ void PRadGEMAPV::ClearData()
     for(uint32_t i = 0; i < buffer_size; ++i)
         raw_data[i] = 5000.;
 
-    ResetHitPos();
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE*ts_stride; ++i)
+        strip_data[i] = 0.;
+
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+        hit_pos[i] = false;
+    hit_count = 0;
 }
 
-// reset hit position array
+// reset hit position array, only the hit strips are touched
 void PRadGEMAPV::ResetHitPos()
 {
-    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
-        hit_pos[i] = false;
+    for(uint32_t i = 0; i < hit_count; ++i)
+        hit_pos[hit_list[i]] = false;
+    hit_count = 0;
 }
 
 // clear all the pedestal
@@ -345,6 +411,8 @@ void PRadGEMAPV::ClearPedestal()
 {
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
         pedestal[i] = Pedestal(0, 0);
+
+    kernel_valid = false;
 }
 
 // update pedestal
@@ -352,6 +420,8 @@ void PRadGEMAPV::UpdatePedestal(std::vector<Pedestal> &ped)
 {
     for(uint32_t i = 0; (i < ped.size()) && (i < TIME_SAMPLE_SIZE); ++i)
         pedestal[i] = ped[i];
+
+    kernel_valid = false;
 }
 
 // update single channel pedestal
@@ -361,6 +431,7 @@ void PRadGEMAPV::UpdatePedestal(const Pedestal &ped, const uint32_t &index)
         return;
 
     pedestal[index] = ped;
+    kernel_valid = false;
 }
 
 // update single channel pedestal
@@ -371,6 +442,7 @@ void PRadGEMAPV::UpdatePedestal(const float &offset, const float &noise, const u
 
     pedestal[index].offset = offset;
     pedestal[index].noise = noise;
+    kernel_valid = false;
 }
 
 // fill raw data
@@ -383,7 +455,25 @@ void PRadGEMAPV::FillRawData(const uint32_t *buf, const uint32_t &size)
         return;
     }
 
-    for(uint32_t i = 0; i < size; ++i)
+    uint32_t i = 0;
+
+#ifdef APV_SSE2_KERNEL
+    // same as SplitData, 4 words at a time
+    const __m128i mask_hi = _mm_set1_epi32(0xff00), mask_lo = _mm_set1_epi32(0xff);
+    for(; i + 4 <= size; i += 4)
+    {
+        __m128i word = _mm_loadu_si128((const __m128i*)&buf[i]);
+        __m128i data1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(word, 8), mask_hi),
+                                     _mm_srli_epi32(word, 24));
+        __m128i data2 = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(word, 8), mask_hi),
+                                     _mm_and_si128(_mm_srli_epi32(word, 8), mask_lo));
+        __m128 word1 = _mm_cvtepi32_ps(data1), word2 = _mm_cvtepi32_ps(data2);
+        _mm_storeu_ps(&raw_data[2*i], _mm_unpacklo_ps(word1, word2));
+        _mm_storeu_ps(&raw_data[2*i + 4], _mm_unpackhi_ps(word1, word2));
+    }
+#endif
+
+    for(; i < size; ++i)
     {
         SplitData(buf[i], raw_data[2*i], raw_data[2*i+1]);
     }
@@ -394,11 +484,7 @@ void PRadGEMAPV::FillRawData(const uint32_t *buf, const uint32_t &size)
 // fill zero suppressed data
 void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const uint32_t &ts, const unsigned short &val)
 {
-    ts_index = 0;
-    uint32_t idx = ch + ts_index + ts*TIME_SAMPLE_DIFF;
-    if(ts >= time_samples ||
-       ch >= TIME_SAMPLE_SIZE ||
-       idx >= buffer_size)
+    if(ts >= time_samples || ch >= TIME_SAMPLE_SIZE)
     {
         std::cerr << "GEM APV Error: Failed to fill zero suppressed data, "
                   << " channel " << ch << " or time sample " << ts
@@ -407,15 +493,19 @@ void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const uint32_t &ts, const u
         return;
     }
 
-    hit_pos[ch] = true;
-    raw_data[idx] = val;
+    addHit(ch);
+    stripData(ch)[ts] = val;
 }
 
 // fill zero suppressed data
 void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const std::vector<float> &vals)
 {
-    ts_index = 0;
+    FillZeroSupData(ch, GEMSamples(vals));
+}
 
+// fill zero suppressed data
+void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const GEMSamples &vals)
+{
     if(vals.size() != time_samples || ch >= TIME_SAMPLE_SIZE)
     {
         std::cerr << "GEM APV Error: Failed to fill zero suppressed data, "
@@ -425,14 +515,13 @@ void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const std::vector<float> &v
         return;
     }
 
-    hit_pos[ch] = true;
+    addHit(ch);
 
+    float *data = stripData(ch);
     for(uint32_t i = 0; i < vals.size(); ++i)
     {
-        uint32_t idx = ch + ts_index + i*TIME_SAMPLE_DIFF;
-        raw_data[idx] = vals[i];
+        data[i] = vals[i];
     }
-
 }
 
 // split the data word, since one data word stores two channels' data
@@ -447,7 +536,7 @@ void PRadGEMAPV::SplitData(const uint32_t &data, float &word1, float &word2)
 // fill pedestal histogram
 void PRadGEMAPV::FillPedHist()
 {
-    float average[2][3];
+    float average[2][GEM_MAX_TIME_SAMPLES];
 
     for(uint32_t i = 0; i < time_samples; ++i)
     {
@@ -476,6 +565,9 @@ void PRadGEMAPV::FillPedHist()
             }
         }
 
+        offset_est[i].Fill(ch_average/time_samples);
+        noise_est[i].Fill(noise_average/time_samples);
+
         if(offset_hist[i])
             offset_hist[i]->Fill(ch_average/time_samples);
 
@@ -484,23 +576,52 @@ void PRadGEMAPV::FillPedHist()
     }
 }
 
-// fit pedestal histogram
-void PRadGEMAPV::FitPedestal()
+// update pedestal from the estimators, the histograms are fitted as a cross
+// check if they exist and fit_check is true, warnings go to os
+// the fits use the gaussian function fit if it is given, it needs to be given
+// when several APVs are fitted in parallel
+void PRadGEMAPV::FitPedestal(const bool &fit_check, std::ostream &os, TF1 *fit)
 {
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
-        if( (offset_hist[i] == nullptr) ||
-            (noise_hist[i] == nullptr) ||
-            (offset_hist[i]->Integral() < 1000) ||
-            (noise_hist[i]->Integral() < 1000) )
+        if( (offset_est[i].GetEntries() < 1000) ||
+            (noise_est[i].GetEntries() < 1000) )
             continue;
 
-        offset_hist[i]->Fit("gaus", "qww");
-        noise_hist[i]->Fit("gaus", "qww");
-        TF1 *myfit = (TF1*) offset_hist[i]->GetFunction("gaus");
-        double p0 = myfit->GetParameter(1);
-        myfit = (TF1*) noise_hist[i]->GetFunction("gaus");
-        double p1 = myfit->GetParameter(2);
+        double p0 = offset_est[i].GetMean();
+        double p1 = noise_est[i].GetSigma();
+
+        if( fit_check &&
+            (offset_hist[i] != nullptr) &&
+            (noise_hist[i] != nullptr) &&
+            (offset_hist[i]->Integral() >= 1000) &&
+            (noise_hist[i]->Integral() >= 1000) ) {
+            const char *fname = fit ? fit->GetName() : "gaus";
+            if(fit) {
+                offset_hist[i]->Fit(fit, "qww");
+                noise_hist[i]->Fit(fit, "qww");
+            } else {
+                offset_hist[i]->Fit("gaus", "qww");
+                noise_hist[i]->Fit("gaus", "qww");
+            }
+            TF1 *myfit = offset_hist[i]->GetFunction(fname);
+            double f0 = myfit->GetParameter(1);
+            myfit = noise_hist[i]->GetFunction(fname);
+            double f1 = myfit->GetParameter(2);
+
+            // the raw offset spread includes the common mode, so only its mean
+            // is compared (in units of the noise), the width is checked on the
+            // noise distribution
+            if( (std::abs(offset_est[i].GetMean() - f0) > 0.5*f1) ||
+                !noise_est[i].IsConsistent(noise_est[i].GetMean(), f1) ) {
+                os << "GEM APV Warning: Pedestal of APV "
+                   << fec_id << ", " << adc_ch << ", channel " << i
+                   << " is estimated as (" << p0 << ", " << p1
+                   << "), but the fit gives (" << f0 << ", " << f1 << ")."
+                   << std::endl;
+            }
+        }
+
         UpdatePedestal((float)p0, (float)p1, i);
     }
 }
@@ -527,44 +648,44 @@ void PRadGEMAPV::ZeroSuppression()
         return;
     }
 
-    // common mode correction
+    if(!kernel_valid)
+        updateKernel();
+
+    // common mode correction, the corrected charges are written once in strip
+    // order and summed for each strip in the same pass, all the following
+    // operations on one strip read contiguous memory
+    float strip_sum[TIME_SAMPLE_SIZE] = {0.};
     for(uint32_t ts = 0; ts < time_samples; ++ts)
     {
-        if(split)
-            CommonModeCorrection_Split(&raw_data[ts_index + ts*TIME_SAMPLE_DIFF], TIME_SAMPLE_SIZE);
-        else
-            CommonModeCorrection(&raw_data[ts_index + ts*TIME_SAMPLE_DIFF], TIME_SAMPLE_SIZE);
+        commonModeCorrection(&raw_data[ts_index + ts*TIME_SAMPLE_DIFF], ts, strip_sum);
     }
 
+    // no branch so it can be vectorized
     for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
     {
-        float average = 0.;
-        for(uint32_t j = 0; j < time_samples; ++j)
-        {
-            average += raw_data[i + ts_index + j*TIME_SAMPLE_DIFF];
-        }
-        average /= time_samples;
+        hit_pos[i] = (strip_sum[i]/time_samples > zs_thres[i]);
+    }
 
-        if(average > pedestal[i].noise * zerosup_thres)
-            hit_pos[i] = true;
-        else
-            hit_pos[i] = false;
+    // list the hit strips in order
+    hit_count = 0;
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+    {
+        hit_list[hit_count] = i;
+        hit_count += hit_pos[i];
     }
 }
 
 // collect zero suppressed hit in raw data space, need a container input
 void PRadGEMAPV::CollectZeroSupHits(std::vector<GEM_Data> &hits)
 {
-    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
-    {
-        if(hit_pos[i] == false)
-            continue;
+    sortHits();
 
+    for(uint32_t k = 0; k < hit_count; ++k)
+    {
+        uint32_t i = hit_list[k];
         GEM_Data hit(fec_id, adc_ch, i);
-        for(uint32_t j = 0; j < time_samples; ++j)
-        {
-            hit.values.emplace_back(raw_data[i + ts_index + j*TIME_SAMPLE_DIFF]);
-        }
+        const float *data = stripData(i);
+        hit.values.assign(data, data + time_samples);
         hits.emplace_back(hit);
     }
 }
@@ -575,85 +696,25 @@ void PRadGEMAPV::CollectZeroSupHits()
     if(plane == nullptr)
         return;
 
-    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+    sortHits();
+
+    int apv_id = (fec_id<<4) | adc_ch;
+    for(uint32_t k = 0; k < hit_count; ++k)
     {
-        if(hit_pos[i] == false)
+        uint32_t i = hit_list[k];
+        // strips not used by the plane
+        if(!strip_map[i].valid)
             continue;
 
-        std::vector<float> charges;
-        for(uint32_t j = 0; j < time_samples; ++j)
-        {
-            charges.push_back(raw_data[i + ts_index + j*TIME_SAMPLE_DIFF]);
-        }
-	int apv_id = (fec_id<<4) | adc_ch;
         plane->AddStripHit(strip_map[i].plane,
-                           charges,
+                           strip_map[i].position,
+                           stripData(i),
+                           time_samples,
                            IsCrossTalkStrip(i),
 			   apv_id);
     }
 }
 
-// do common mode correction (bring the signal average to 0)
-void PRadGEMAPV::CommonModeCorrection(float *buf, const uint32_t &size)
-{
-    int count = 0;
-    float average = 0;
-
-    for(uint32_t i = 0; i < size; ++i)
-    {
-        buf[i] = pedestal[i].offset - buf[i];
-
-        if(buf[i] < pedestal[i].noise * common_thres) {
-            average += buf[i];
-            count++;
-        }
-    }
-
-    if(count)
-        average /= (float)count;
-
-    for(uint32_t i = 0; i < size; ++i)
-    {
-        buf[i] -= average;
-    }
-}
-
-// do common mode correction for split APV
-void PRadGEMAPV::CommonModeCorrection_Split(float *buf, const uint32_t &size)
-{
-    int count1 = 0, count2 = 0;
-    float average1 = 0, average2 = 0;
-
-    for(uint32_t i = 0; i < size; ++i)
-    {
-        buf[i] = pedestal[i].offset - buf[i];
-        if(strip_map[i].local < 16) {
-            if(buf[i] < pedestal[i].noise * common_thres * 10.) {
-                average1 += buf[i];
-                count1++;
-            }
-        } else {
-            if(buf[i] < pedestal[i].noise * common_thres) {
-                average2 += buf[i];
-                count2++;
-            }
-        }
-    }
-
-    if(count1)
-        average1 /= (float)count1;
-    if(count2)
-        average2 /= (float)count2;
-
-    for(uint32_t i = 0; i < size; ++i)
-    {
-        if(strip_map[i].local < 16)
-            buf[i] -= average1;
-        else
-            buf[i] -= average2;
-    }
-}
-
 // get the local strip number from strip map
 int PRadGEMAPV::GetLocalStripNb(const uint32_t &ch)
 const
@@ -725,6 +786,10 @@ PRadGEMAPV::StripNb PRadGEMAPV::MapStrip(int ch)
 
     result.plane = strip;
 
+    // strip geometry from the plane
+    result.position = plane->GetStripPosition(strip);
+    result.valid = plane->IsValidStrip(strip);
+
     return result;
 }
 
@@ -783,28 +848,29 @@ const
         return false;
 
     float max_charge = 0., pre_max = 0., next_max = 0.;
+    const float *cur = stripData(strip);
     for(uint32_t j = 0; j < time_samples; ++j)
     {
-        float cur_charge = raw_data[strip + ts_index + j*TIME_SAMPLE_DIFF];
-        if(cur_charge > max_charge)
-            max_charge = cur_charge;
+        if(cur[j] > max_charge)
+            max_charge = cur[j];
     }
 
+    // neighbor strips are the adjacent rows
     if(strip > 0 && hit_pos[strip-1]) {
+        const float *pre = cur - ts_stride;
         for(uint32_t j = 0; j < time_samples; ++j)
         {
-            float pre_charge = raw_data[strip-1 + ts_index + j*TIME_SAMPLE_DIFF];
-            if(pre_charge > pre_max)
-                pre_max = pre_charge;
+            if(pre[j] > pre_max)
+                pre_max = pre[j];
         }
     }
 
     if(strip < TIME_SAMPLE_SIZE - 1 && hit_pos[strip+1]) {
+        const float *next = cur + ts_stride;
         for(uint32_t j = 0; j < time_samples; ++j)
         {
-            float next_charge = raw_data[strip+1 + ts_index + j*TIME_SAMPLE_DIFF];
-            if(next_charge > next_max)
-                next_max = next_charge;
+            if(next[j] > next_max)
+                next_max = next[j];
         }
     }
 
@@ -821,9 +887,31 @@ const
 //============================================================================//
 
 // Compare the data with header level and find where the time sample data begin
+// the header is the first 3 consecutive words below the header level
 uint32_t PRadGEMAPV::getTimeSampleStart()
 {
-    for(uint32_t i = 2; i < buffer_size; ++i)
+    uint32_t i = 2;
+
+#ifdef APV_SSE2_KERNEL
+    // compare 4 words at a time, the bits of the last 2 words are carried to
+    // the next block, so a header across the blocks is also found
+    const __m128 level = _mm_set1_ps(header_level);
+    uint32_t prev = 0;
+    uint32_t j = 0;
+    for(; j + 4 <= buffer_size; j += 4)
+    {
+        uint32_t below = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(&raw_data[j]), level));
+        uint32_t bits = (below << 2) | prev;
+        // bit k means words j + k - 2, j + k - 1 and j + k are all below
+        uint32_t header = bits & (bits >> 1) & (bits >> 2) & 0xf;
+        if(header)
+            return j + __builtin_ctz(header) + 10;
+        prev = bits >> 4;
+    }
+    i = std::max(j, i);
+#endif
+
+    for(; i < buffer_size; ++i)
     {
         if( (raw_data[i]   < header_level) &&
             (raw_data[i-1] < header_level) &&
@@ -858,6 +946,24 @@ void PRadGEMAPV::getAverage(float &average, const float *buf, const uint32_t &se
     average /= (float)count;
 }
 
+// add a strip to the hit list if it is not there yet
+void PRadGEMAPV::addHit(const uint32_t &ch)
+{
+    if(hit_pos[ch])
+        return;
+
+    hit_pos[ch] = true;
+    hit_list[hit_count++] = ch;
+}
+
+// zero suppressed data may come in any order, but the hits are collected in
+// the channel order
+void PRadGEMAPV::sortHits()
+{
+    if(!std::is_sorted(hit_list, hit_list + hit_count))
+        std::sort(hit_list, hit_list + hit_count);
+}
+
 // Build strip map
 // both local strip map and plane strip map are related to the connected plane
 // thus this function will only be called when the APV is connected to the plane
@@ -867,6 +973,123 @@ void PRadGEMAPV::buildStripMap()
     {
         strip_map[i] = MapStrip(i);
     }
+
+    kernel_valid = false;
+}
+
+// rebuild strip map after the connected plane is changed
+void PRadGEMAPV::UpdateStripMap()
+{
+    if(plane != nullptr)
+        buildStripMap();
+}
+
+// build the per channel tables used by the zero suppression kernel
+// the first 16 strips of a split APV are set 1 and have a looser common mode
+// threshold, all the other strips are set 2
+void PRadGEMAPV::updateKernel()
+{
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+    {
+        bool set1 = split && (strip_map[i].local < 16);
+        cm_offset[i] = pedestal[i].offset;
+        cm_thres[i] = pedestal[i].noise * common_thres * (set1 ? 10.f : 1.f);
+        zs_thres[i] = pedestal[i].noise * zerosup_thres;
+        cm_set[i] = set1 ? -1 : 0;
+    }
+
+    kernel_valid = true;
+}
+
+// do common mode correction (bring the signal average to 0) for one time sample
+// the corrected charges go to the strip data and are added to the strip sums
+// channels below the common mode threshold are averaged for each set, the sums
+// go to 8 lanes that are combined in a fixed order, so the SSE2 path and the
+// scalar path have exactly the same floating point operations
+void PRadGEMAPV::commonModeCorrection(float *buf, const uint32_t &ts, float *strip_sum)
+{
+    float sum1[4], sum2[4];
+    int count1 = 0, count2 = 0;
+
+#ifdef APV_SSE2_KERNEL
+    __m128 acc1[2] = {_mm_setzero_ps(), _mm_setzero_ps()};
+    __m128 acc2[2] = {_mm_setzero_ps(), _mm_setzero_ps()};
+    __m128i cnt1 = _mm_setzero_si128(), cnt2 = _mm_setzero_si128();
+
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; i += 4)
+    {
+        __m128 val = _mm_sub_ps(_mm_loadu_ps(&cm_offset[i]), _mm_loadu_ps(&buf[i]));
+        _mm_storeu_ps(&buf[i], val);
+
+        __m128 in = _mm_cmplt_ps(val, _mm_loadu_ps(&cm_thres[i]));
+        __m128 set = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&cm_set[i]));
+        __m128 in1 = _mm_and_ps(in, set), in2 = _mm_andnot_ps(set, in);
+
+        int lane = (i/4)&1;
+        acc1[lane] = _mm_add_ps(acc1[lane], _mm_and_ps(in1, val));
+        acc2[lane] = _mm_add_ps(acc2[lane], _mm_and_ps(in2, val));
+        cnt1 = _mm_sub_epi32(cnt1, _mm_castps_si128(in1));
+        cnt2 = _mm_sub_epi32(cnt2, _mm_castps_si128(in2));
+    }
+
+    _mm_storeu_ps(sum1, _mm_add_ps(acc1[0], acc1[1]));
+    _mm_storeu_ps(sum2, _mm_add_ps(acc2[0], acc2[1]));
+
+    int32_t cnt[4];
+    _mm_storeu_si128((__m128i*)cnt, cnt1);
+    count1 = cnt[0] + cnt[1] + cnt[2] + cnt[3];
+    _mm_storeu_si128((__m128i*)cnt, cnt2);
+    count2 = cnt[0] + cnt[1] + cnt[2] + cnt[3];
+#else
+    float acc1[8] = {0.}, acc2[8] = {0.};
+
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+    {
+        float val = cm_offset[i] - buf[i];
+        buf[i] = val;
+
+        bool in = val < cm_thres[i];
+        bool in1 = in && cm_set[i], in2 = in && !cm_set[i];
+        acc1[i%8] += in1 ? val : 0.f;
+        acc2[i%8] += in2 ? val : 0.f;
+        count1 += in1;
+        count2 += in2;
+    }
+
+    for(int i = 0; i < 4; ++i)
+    {
+        sum1[i] = acc1[i] + acc1[i + 4];
+        sum2[i] = acc2[i] + acc2[i + 4];
+    }
+#endif
+
+    float average1 = 0., average2 = 0.;
+    if(count1)
+        average1 = ((sum1[0] + sum1[1]) + (sum1[2] + sum1[3]))/(float)count1;
+    if(count2)
+        average2 = ((sum2[0] + sum2[1]) + (sum2[2] + sum2[3]))/(float)count2;
+
+#ifdef APV_SSE2_KERNEL
+    __m128 ave1 = _mm_set1_ps(average1), ave2 = _mm_set1_ps(average2);
+    float val[4];
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; i += 4)
+    {
+        __m128 set = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&cm_set[i]));
+        __m128 ave = _mm_or_ps(_mm_and_ps(set, ave1), _mm_andnot_ps(set, ave2));
+        __m128 cval = _mm_sub_ps(_mm_loadu_ps(&buf[i]), ave);
+        _mm_storeu_ps(&strip_sum[i], _mm_add_ps(_mm_loadu_ps(&strip_sum[i]), cval));
+        _mm_storeu_ps(val, cval);
+        for(uint32_t j = 0; j < 4; ++j)
+            strip_data[(i + j)*ts_stride + ts] = val[j];
+    }
+#else
+    for(uint32_t i = 0; i < TIME_SAMPLE_SIZE; ++i)
+    {
+        float val = buf[i] - (cm_set[i] ? average1 : average2);
+        strip_data[i*ts_stride + ts] = val;
+        strip_sum[i] += val;
+    }
+#endif
 }
 
 //============================================================================//
@@ -13,6 +13,7 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 #include <vector>
 #include "PRadGEMCluster.h"
 #include "PRadGEMDetector.h"
@@ -45,6 +46,18 @@ void PRadGEMCluster::Configure(const std::string &path)
     split_cluster_diff = getDefConfig<float>("Split Threshold", 14, verbose);
     cross_talk_width = getDefConfig<float>("Cross Talk Width", 2, verbose);
 
+    // x, y cluster pairing, Cartesian forms all the combinations, Charge only
+    // pairs the clusters that have similar charges
+    std::string pairing = getDefConfig<std::string>("XY Pairing", "Cartesian", verbose);
+    charge_match = ConfigParser::strcmp_case_insensitive(pairing, "Charge");
+    if(!charge_match && !ConfigParser::strcmp_case_insensitive(pairing, "Cartesian")) {
+        std::cout << "PRad GEM Cluster Warning: Unknown XY pairing method "
+                  << pairing << ", use Cartesian pairing instead."
+                  << std::endl;
+    }
+    charge_asym_cut = getDefConfig<float>("Charge Asymmetry Cut", 0.3, verbose);
+    max_cluster_pairs = getDefConfig<unsigned int>("Max Pairs Per Cluster", 1, verbose);
+
     // get cross talk characteristic distance
     charac_distance.clear();
     std::string dist_str = GetConfig<std::string>("Characteristic Distance");
@@ -95,58 +108,79 @@ const
                   return h1.strip < h2.strip;
               });
 
+    // overlapped APVs share some strips, so a strip number can appear twice
+    // find the first shared strip
+    size_t nhits = hits.size(), shared = nhits;
+    for(size_t i = 0; i + 1 < nhits; ++i)
+    {
+        if(hits[i].strip == hits[i + 1].strip) {
+            shared = i;
+            break;
+        }
+    }
+
+    // beginning of the cluster that reaches the first shared strip
+    size_t shared_begin = shared;
+    while(shared_begin > 0 && shared_begin < nhits &&
+          hits[shared_begin].strip - hits[shared_begin - 1].strip <= 1)
+        --shared_begin;
+
     // group the hits that have consecutive strip number
-    auto cluster_begin = hits.begin();
-    for(auto it = hits.begin(); it != hits.end(); ++it)
+    bool new_cluster = true;
+    for(size_t i = 0; i < shared_begin; ++i)
+        addConsecutiveHit(clusters, hits[i], new_cluster);
+
+    if(shared == nhits)
+        return;
+
+    // the rest strips are dispatched to two groups by APV ID, the strips
+    // before the shared one in the same cluster belong to both groups, with
+    // half of the charges
+    // a strip cannot repeat inside one group: an APV adds each channel once
+    // (addHit), its channel to strip map is one to one, and the APVs of a
+    // plane cover separate strip ranges except for the special one at plane
+    // index 11, which is OVERLAP_APV1 (GEM1) or OVERLAP_APV2 (GEM2) in the
+    // map, so each plane has one overlap APV and the repeats are all between
+    // the two groups
+    // the old recursion did not terminate on a repeat inside a group, here it
+    // would be merged into the cluster as a consecutive strip
+    for(int group = 0; group < 2; ++group)
     {
-        auto next = it + 1;
+        bool overlap_group = (group == 0);
+        new_cluster = true;
 
-        // end of list, group the last cluster
-        if(next == hits.end()) {
-            clusters.emplace_back(std::vector<StripHit>(cluster_begin, next));
-            break;
+        for(size_t i = shared_begin; i < shared; ++i)
+        {
+            StripHit half_hit = hits[i];
+            half_hit.charge /= 2;
+            addConsecutiveHit(clusters, half_hit, new_cluster);
         }
 
-	// recursively group hits for overlapped APVs
-	if( next->strip == it->strip)
-	{
-	    auto duplicated_begin = cluster_begin;
-	    std::vector<StripHit> dup1, dup2;
-	    // duplicate shared strips
-	    for(auto itd=duplicated_begin; itd!= it; ++itd)
-	    {
-	        dup1.push_back(*itd);
-		dup2.push_back(*itd);
-	    }
-	    // divide charges by half for shared strips
-	    for(auto &i: dup1)
-	        i.charge/=2;
-	    for(auto &i: dup2)
-	        i.charge/=2;
-	    // dispatch the rest strips by APV ID
-	    for(auto itd = it; itd != hits.end(); ++itd)
-	    {
-	        if(itd->apv_id == OVERLAP_APV1 || itd->apv_id == OVERLAP_APV2){
-		    dup1.push_back(*itd);
-		} else {
-		    dup2.push_back(*itd);
-		}
-	    }
-	    // group the remaining strips into clusters
-	    groupHits(dup1, clusters);
-	    groupHits(dup2, clusters);
-
-	    break; // finished all grouping, break out the entire loop
-	}
-
-        // check consecutivity
-        if(next->strip - it->strip > 1) {
-            clusters.emplace_back(std::vector<StripHit>(cluster_begin, next));
-            cluster_begin = next;
+        for(size_t i = shared; i < nhits; ++i)
+        {
+            bool overlap = (hits[i].apv_id == OVERLAP_APV1) ||
+                           (hits[i].apv_id == OVERLAP_APV2);
+            if(overlap == overlap_group)
+                addConsecutiveHit(clusters, hits[i], new_cluster);
         }
     }
 }
 
+// add the hit to the last cluster, or start a new cluster if it is not
+// consecutive to the last hit
+inline void PRadGEMCluster::addConsecutiveHit(std::vector<StripCluster> &clusters,
+                                              const StripHit &hit,
+                                              bool &new_cluster)
+const
+{
+    if(new_cluster || hit.strip - clusters.back().hits.back().strip > 1) {
+        clusters.emplace_back();
+        new_cluster = false;
+    }
+
+    clusters.back().hits.push_back(hit);
+}
+
 // split cluster at valley
 void PRadGEMCluster::splitCluster(std::vector<StripCluster> &clusters)
 const
@@ -157,42 +191,55 @@ const
     // will be separated, and each gets 1/2 of the charge from the overlap
     // strip.
 
-    // loop over the cluster list
-    // since the vector size is changing, it cannot use iterator
-    for(size_t i = 0; i < clusters.size(); ++i)
+    // the clusters after split are written into a second buffer in order
+    static thread_local std::vector<StripCluster> split_clusters;
+    split_clusters.clear();
+
+    for(auto &cluster : clusters)
     {
-        // no need to do separation if less than 3 hits
-        if(clusters[i].hits.size() < 3)
-            continue;
+        auto &hits = cluster.hits;
+        auto part_begin = hits.begin();
 
-        // new cluster for the latter part after split
-        StripCluster split_cluster;
+        // no need to do separation if less than 3 hits
+        while(hits.end() - part_begin >= 3)
+        {
+            auto minimum = findValley(part_begin, hits.end());
+            if(minimum == hits.end())
+                break;
 
-        // insert the splited cluster if there is one
-        if(splitCluster_sub(clusters[i], split_cluster)) {
-            // insert keeps the original order, but has a worse performance
-            clusters.insert(clusters.begin()+i+1, split_cluster);
+            // half the charge of overlap strip, it is kept by both parts
+            minimum->charge /= 2.;
+            split_clusters.emplace_back();
+            split_clusters.back().hits.assign(part_begin, minimum + 1);
+            part_begin = minimum;
         }
+
+        // the last part
+        hits.erase(hits.begin(), part_begin);
+        split_clusters.emplace_back(std::move(cluster));
     }
+
+    clusters.swap(split_clusters);
+    split_clusters.clear();
 }
 
 // This function helps splitCluster
-// It finds the FIRST local minimum, separate the cluster at its position
-// The charge at local minimum strip will be halved, and kept for both original
-// and split clusters.
-// It returns true if a cluster is split, and vice versa
-// The split part of the original cluster c will be removed, and filled in c1
-bool PRadGEMCluster::splitCluster_sub(StripCluster &c, StripCluster &c1)
+// It finds the FIRST local minimum in the hits range, the cluster will be
+// separated at its position
+// It returns the minimum or the end of range if there is no valley
+std::vector<StripHit>::iterator
+PRadGEMCluster::findValley(std::vector<StripHit>::iterator begin,
+                           std::vector<StripHit>::iterator end)
 const
 {
     // we use 2 consecutive iterator
-    auto it = c.hits.begin();
+    auto it = begin;
     auto it_next = it + 1;
 
     // loop to find the local minimum
-    bool descending = false, extremum = false;
+    bool descending = false;
     auto minimum = it;
-    for(; it_next != c.hits.end(); ++it, ++it_next)
+    for(; it_next != end; ++it, ++it_next)
     {
         if(descending) {
             // update minimum
@@ -200,11 +247,9 @@ const
                 minimum = it;
 
             // transcending trend, confirm a local minimum (valley)
-            if(it_next->charge - it->charge > split_cluster_diff) {
-                extremum = true;
-                // only needs the first local minimum, thus exit the loop
-                break;
-            }
+            // only needs the first local minimum
+            if(it_next->charge - it->charge > split_cluster_diff)
+                return minimum;
         } else {
             // descending trend, expect a local minimum
             if(it->charge - it_next->charge > split_cluster_diff) {
@@ -214,60 +259,107 @@ const
         }
     }
 
-    if(extremum) {
-        // half the charge of overlap strip
-        minimum->charge /= 2.;
-
-        // new split cluster
-        c1 = StripCluster(std::vector<StripHit>(minimum, c.hits.end()));
-
-        // remove the hits that are moved into new cluster, but keep the minimum
-        c.hits.erase(std::next(minimum, 1), c.hits.end());
-    }
-
-    return extremum;
+    return end;
 }
 
 // filter out bad clusters
 #define MAX_CLUSTER_WIDTH 2.0
+// widen the search ranges of cross talk distance for the rounding
+#define CROSS_TALK_MARGIN 0.01
 void PRadGEMCluster::filterCluster(std::vector<StripCluster> &clusters)
 const
 {
     // remove cluster that has too less/many hits
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
+    clusters.erase(std::remove_if(clusters.begin(), clusters.end(),
+                                  [this](const StripCluster &c)
+                                  {
+                                      return (c.hits.size() < min_cluster_hits) ||
+                                             (c.hits.size() > max_cluster_hits);
+                                  }),
+                   clusters.end());
+
+    if(std::none_of(clusters.begin(), clusters.end(),
+                    [](const StripCluster &c) {return c.IsCrossTalk();}))
+        return;
+
+    // remove cross talk cluster
+    // the clusters are sorted by position for the distance search, a cross
+    // talk cluster is removed right away, so the later ones are not checked
+    // against it
+    static thread_local std::vector<std::pair<float, uint32_t>> positions;
+    static thread_local std::vector<char> removed;
+
+    positions.clear();
+    for(uint32_t i = 0; i < clusters.size(); ++i)
     {
-        if((it->hits.size() < min_cluster_hits) ||
-           (it->hits.size() > max_cluster_hits))
-            clusters.erase(it--);
+        if(!std::isnan(clusters[i].position))
+            positions.emplace_back(clusters[i].position, i);
     }
+    std::sort(positions.begin(), positions.end());
+    removed.assign(clusters.size(), 0);
 
-    // remove cross talk cluster
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
+    for(size_t i = 0; i < clusters.size(); ++i)
     {
-	    if(filterCrossTalk(*it, clusters)) {
-            clusters.erase(it--);
-        }
+        if(filterCrossTalk(clusters[i], positions, removed))
+            removed[i] = 1;
     }
 
+    // keep the order of the remaining clusters
+    size_t nkeep = 0;
+    for(size_t i = 0; i < clusters.size(); ++i)
+    {
+        if(removed[i])
+            continue;
+        if(nkeep != i)
+            clusters[nkeep] = std::move(clusters[i]);
+        ++nkeep;
+    }
+    clusters.erase(clusters.begin() + nkeep, clusters.end());
 }
 
+// check if the cluster is a cross talk of any remaining clusters
+// positions are the sorted positions of clusters
 bool PRadGEMCluster::filterCrossTalk(const StripCluster &cluster,
-                                     const std::vector<StripCluster> &clusters)
+                                     const std::vector<std::pair<float, uint32_t>> &positions,
+                                     const std::vector<char> &removed)
 const
 {
-    if(!cluster.IsCrossTalk())
+    if(!cluster.IsCrossTalk() || std::isnan(cluster.position))
         return false;
 
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
+    auto in_range = [&] (double pos_min, double pos_max, double dist)
+                    {
+                        auto it = std::lower_bound(positions.begin(), positions.end(), pos_min,
+                                                   [](const std::pair<float, uint32_t> &p,
+                                                      const double &val)
+                                                   {
+                                                       return p.first < val;
+                                                   });
+
+                        for(; it != positions.end() && it->first <= pos_max; ++it)
+                        {
+                            if(removed[it->second])
+                                continue;
+
+                            double delta = fabs(it->first - cluster.position);
+                            if(delta > dist - cross_talk_width &&
+                               delta < dist + cross_talk_width)
+                                return true;
+                        }
+                        return false;
+                    };
+
+    for(auto &dist : charac_distance)
     {
-        double delta = fabs(it->position - cluster.position);
+        // the other cluster is at dist +- width on either side
+        double d_min = std::max(0., dist - cross_talk_width - CROSS_TALK_MARGIN);
+        double d_max = dist + cross_talk_width + CROSS_TALK_MARGIN;
+        if(d_max < 0.)
+            continue;
 
-        for(auto &dist : charac_distance)
-        {
-            if(delta > dist - cross_talk_width &&
-               delta < dist + cross_talk_width)
-                return true;
-        }
+        if(in_range(cluster.position - d_max, cluster.position - d_min, dist) ||
+           in_range(cluster.position + d_min, cluster.position + d_max, dist))
+            return true;
     }
 
     return false;
@@ -303,6 +395,18 @@ const
     }
 }
 
+// form GEM hits from x, y clusters with the configured pairing method
+void PRadGEMCluster::Reconstruct(const std::vector<StripCluster> &x_cluster,
+                                 const std::vector<StripCluster> &y_cluster,
+                                 std::vector<GEMHit> &container)
+const
+{
+    if(charge_match)
+        ChargeMatchReconstruct(x_cluster, y_cluster, container);
+    else
+        CartesianReconstruct(x_cluster, y_cluster, container);
+}
+
 // this function accepts x, y clusters from detectors and then form GEM Cluster
 // it return the number of clusters
 void PRadGEMCluster::CartesianReconstruct(const std::vector<StripCluster> &x_cluster,
@@ -326,3 +430,126 @@ const
         }
     }
 }
+
+// a candidate pair of x, y clusters
+struct ClusterPair
+{
+    float asym;
+    uint32_t x, y;
+
+    ClusterPair(float a, uint32_t ix, uint32_t iy) : asym(a), x(ix), y(iy) {};
+};
+
+// x and y strips collect the charges from the same avalanche, so the clusters
+// from one particle should have similar total charges
+// this function pairs x, y clusters by their charge asymmetry
+// |Qx - Qy|/(Qx + Qy), the pairs that pass the cut are accepted from the
+// best matched one, and each cluster is used by at most max_cluster_pairs pairs
+// thus the number of ghost hits is limited
+void PRadGEMCluster::ChargeMatchReconstruct(const std::vector<StripCluster> &x_cluster,
+                                            const std::vector<StripCluster> &y_cluster,
+                                            std::vector<GEMHit> &container)
+const
+{
+    // empty first
+    container.clear();
+
+    if(x_cluster.empty() || y_cluster.empty() || !max_cluster_pairs)
+        return;
+
+    static thread_local std::vector<uint32_t> y_order;
+    static thread_local std::vector<ClusterPair> pairs;
+    static thread_local std::vector<unsigned int> x_used, y_used;
+
+    // sort y clusters by charge, so the candidates of a x cluster are in a range
+    y_order.resize(y_cluster.size());
+    for(uint32_t i = 0; i < y_order.size(); ++i)
+        y_order[i] = i;
+    std::sort(y_order.begin(), y_order.end(),
+              [&y_cluster](const uint32_t &i, const uint32_t &j)
+              {
+                  return y_cluster[i].total_charge < y_cluster[j].total_charge;
+              });
+
+    auto asymmetry = [](float q1, float q2)
+                     {
+                         return std::abs(q1 - q2)/(q1 + q2);
+                     };
+
+    // for positive charges, asymmetry < cut means the ratio Qy/Qx is within
+    // [(1 - cut)/(1 + cut), (1 + cut)/(1 - cut)], the range is slightly widened
+    // for the rounding and the cut is checked again for each candidate
+    bool full_range = (charge_asym_cut >= 1.);
+    float low_ratio = (1. - charge_asym_cut)/(1. + charge_asym_cut)*0.999;
+    float high_ratio = full_range ? 0. : (1. + charge_asym_cut)/(1. - charge_asym_cut)*1.001;
+
+    pairs.clear();
+    for(uint32_t ix = 0; ix < x_cluster.size(); ++ix)
+    {
+        float qx = x_cluster[ix].total_charge;
+        auto beg = y_order.begin(), end = y_order.end();
+
+        if(!full_range && qx > 0.) {
+            float q_low = qx*low_ratio, q_high = qx*high_ratio;
+            beg = std::lower_bound(y_order.begin(), y_order.end(), q_low,
+                                   [&y_cluster](const uint32_t &i, const float &q)
+                                   {
+                                       return y_cluster[i].total_charge < q;
+                                   });
+            end = std::upper_bound(beg, y_order.end(), q_high,
+                                   [&y_cluster](const float &q, const uint32_t &i)
+                                   {
+                                       return q < y_cluster[i].total_charge;
+                                   });
+        }
+
+        for(auto it = beg; it != end; ++it)
+        {
+            float asym = asymmetry(qx, y_cluster[*it].total_charge);
+            if(asym <= charge_asym_cut)
+                pairs.emplace_back(asym, ix, *it);
+        }
+    }
+
+    // accept the best matched pairs first
+    std::sort(pairs.begin(), pairs.end(),
+              [](const ClusterPair &p1, const ClusterPair &p2)
+              {
+                  if(p1.asym != p2.asym)
+                      return p1.asym < p2.asym;
+                  if(p1.x != p2.x)
+                      return p1.x < p2.x;
+                  return p1.y < p2.y;
+              });
+
+    x_used.assign(x_cluster.size(), 0);
+    y_used.assign(y_cluster.size(), 0);
+    size_t naccept = 0;
+    for(auto &pair : pairs)
+    {
+        if(x_used[pair.x] >= max_cluster_pairs || y_used[pair.y] >= max_cluster_pairs)
+            continue;
+
+        ++x_used[pair.x];
+        ++y_used[pair.y];
+        pairs[naccept++] = pair;
+    }
+    pairs.resize(naccept, ClusterPair(0., 0, 0));
+
+    // keep the same order as the Cartesian pairing
+    std::sort(pairs.begin(), pairs.end(),
+              [](const ClusterPair &p1, const ClusterPair &p2)
+              {
+                  return (p1.x != p2.x) ? (p1.x < p2.x) : (p1.y < p2.y);
+              });
+
+    for(auto &pair : pairs)
+    {
+        auto &xc = x_cluster[pair.x];
+        auto &yc = y_cluster[pair.y];
+        container.emplace_back(xc.position, yc.position, 0.,    // by default z = 0
+                               xc.total_charge, yc.total_charge,
+                               xc.peak_charge, yc.peak_charge,  // fill in peak charge
+                               xc.hits.size(), yc.hits.size()); // number of hits
+    }
+}
@@ -227,16 +227,16 @@ void PRadGEMDetector::Reconstruct(PRadGEMCluster *gem_recon)
         plane->FormClusters(gem_recon);
     }
 
-    // Cartesian reconstruction method
-    // reconstruct event hits from clusters
+    // reconstruct event hits from clusters, the x, y pairing method is
+    // configured in the cluster method
     PRadGEMPlane *plane_x = GetPlane(PRadGEMPlane::Plane_X);
     PRadGEMPlane *plane_y = GetPlane(PRadGEMPlane::Plane_Y);
     // do not have these two planes, cannot reconstruct
     if(!plane_x || !plane_y)
         return;
-    gem_recon->CartesianReconstruct(plane_x->GetStripClusters(),
-                                    plane_y->GetStripClusters(),
-                                    gem_hits);
+    gem_recon->Reconstruct(plane_x->GetStripClusters(),
+                           plane_y->GetStripClusters(),
+                           gem_hits);
 }
 
 // collect all the hits from APVs
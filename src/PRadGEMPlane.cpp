@@ -198,6 +198,17 @@ void PRadGEMPlane::DisconnectAPVs()
     }
 }
 
+// the connected APVs keep the strip positions, rebuild their strip maps
+// when the plane geometry is changed
+void PRadGEMPlane::updateAPVStripMaps()
+{
+    for(auto &apv : apv_list)
+    {
+        if(apv)
+            apv->UpdateStripMap();
+    }
+}
+
 // get existing APV list
 std::vector<PRadGEMAPV*> PRadGEMPlane::GetAPVList()
 const
@@ -230,19 +241,34 @@ const
     return direction*position;
 }
 
+// X plane needs to remove 16 strips at both ends, because they are floating
+// This is a special setup for PRad GEMs, so not configurable
+bool PRadGEMPlane::IsValidStrip(const int &plane_strip)
+const
+{
+    return (type != Plane_X) || ((plane_strip >= 16) && (plane_strip <= 1391));
+}
+
 // get the maximum charge from input charges
 float PRadGEMPlane::GetMaxCharge(const std::vector<float> &charges)
 const
 {
-    if(!charges.size())
+    return GetMaxCharge(charges.data(), charges.size());
+}
+
+// get the maximum charge from input charges
+float PRadGEMPlane::GetMaxCharge(const float *charges, const uint32_t &size)
+const
+{
+    if(!size)
         return 0.;
 
-    float result = charges.at(0);
+    float result = charges[0];
 
-    for(uint32_t i = 1; i < charges.size(); ++i)
+    for(uint32_t i = 1; i < size; ++i)
     {
-        if(result < charges.at(i))
-            result = charges.at(i);
+        if(result < charges[i])
+            result = charges[i];
     }
 
     return result;
@@ -267,20 +293,40 @@ void PRadGEMPlane::ClearStripHits()
 }
 
 // add a plane hit
-// X plane needs to remove 16 strips at both ends, because they are floating
-// This is a special setup for PRad GEMs, so not configurable
 void PRadGEMPlane::AddStripHit(const int &plane_strip,
                                const std::vector<float> &charges,
                                const bool &ct_flag,
 			       const int &apv_id)
 {
-    if((type == Plane_X) &&
-       ((plane_strip < 16) || (plane_strip > 1391)))
+    AddStripHit(plane_strip, charges.data(), charges.size(), ct_flag, apv_id);
+}
+
+// add a plane hit, the charges are the time samples in an array
+void PRadGEMPlane::AddStripHit(const int &plane_strip,
+                               const float *charges,
+                               const uint32_t &size,
+                               const bool &ct_flag,
+                               const int &apv_id)
+{
+    if(!IsValidStrip(plane_strip))
        return;
 
+    AddStripHit(plane_strip, GetStripPosition(plane_strip), charges, size,
+                ct_flag, apv_id);
+}
+
+// add a plane hit with the strip position, the strip is not checked
+// the connected APVs have these from their strip maps
+void PRadGEMPlane::AddStripHit(const int &plane_strip,
+                               const float &position,
+                               const float *charges,
+                               const uint32_t &size,
+                               const bool &ct_flag,
+                               const int &apv_id)
+{
     strip_hits.emplace_back(plane_strip,
-                            GetMaxCharge(charges),
-                            GetStripPosition(plane_strip),
+                            GetMaxCharge(charges, size),
+                            position,
                             ct_flag,
 			    apv_id);
 }
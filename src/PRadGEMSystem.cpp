@@ -17,12 +17,15 @@
 
 #include "PRadGEMSystem.h"
 #include "ConfigParser.h"
+#include "PRadFitDriver.h"
+#include "PRadTaskPool.h"
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
 #include <list>
 #include "TFile.h"
 #include "TH1.h"
+#include "TF1.h"
 
 using namespace std;
 
@@ -34,8 +37,8 @@ using namespace std;
 
 // constructor
 PRadGEMSystem::PRadGEMSystem(const string &config_file, int daq_cap, int det_cap)
-: gem_recon(new PRadGEMCluster()), PedestalMode(false),
-  def_ts(3), def_cth(20.), def_zth(5), def_ctth(8)
+: gem_recon(new PRadGEMCluster()), PedestalMode(false), PedestalFitCheck(false),
+  apv_pool(nullptr), def_ts(3), def_cth(20.), def_zth(5), def_ctth(8)
 {
     daq_slots.resize(daq_cap, nullptr);
     det_slots.resize(det_cap, nullptr);
@@ -51,11 +54,15 @@ PRadGEMSystem::PRadGEMSystem(const string &config_file, int daq_cap, int det_cap
 PRadGEMSystem::PRadGEMSystem(const PRadGEMSystem &that)
 : ConfigObject(that),
   gem_recon(new PRadGEMCluster(*that.gem_recon)), PedestalMode(that.PedestalMode),
+  PedestalFitCheck(that.PedestalFitCheck), apv_pool(nullptr),
   def_ts(that.def_ts), def_cth(that.def_cth), def_zth(that.def_zth),
   def_ctth(that.def_ctth)
 {
     gem_recon = new PRadGEMCluster(*that.gem_recon);
 
+    // threads cannot be copied, create the same number of them
+    SetAPVDecodeThreads(that.GetAPVDecodeThreads());
+
     // copy daq system first
     for(auto &fec : that.daq_slots)
     {
@@ -95,7 +102,8 @@ PRadGEMSystem::PRadGEMSystem(const PRadGEMSystem &that)
 // move constructor
 PRadGEMSystem::PRadGEMSystem(PRadGEMSystem &&that)
 : ConfigObject(that),
-  PedestalMode(that.PedestalMode), det_list(move(that.det_list)),
+  PedestalMode(that.PedestalMode), PedestalFitCheck(that.PedestalFitCheck),
+  apv_pool(that.apv_pool), det_list(move(that.det_list)),
   fec_list(move(that.fec_list)), daq_slots(move(that.daq_slots)),
   det_slots(move(that.det_slots)), det_name_map(move(that.det_name_map)),
   def_ts(that.def_ts), def_cth(that.def_cth), def_zth(that.def_zth),
@@ -103,6 +111,7 @@ PRadGEMSystem::PRadGEMSystem(PRadGEMSystem &&that)
 {
     gem_recon = that.gem_recon;
     that.gem_recon = nullptr;
+    that.apv_pool = nullptr;
 
     // reset the system for all components
     for(auto &fec : fec_list)
@@ -117,6 +126,7 @@ PRadGEMSystem::~PRadGEMSystem()
 {
     Clear();
     delete gem_recon;
+    delete apv_pool;
 }
 
 // copy assignment operator
@@ -135,11 +145,15 @@ PRadGEMSystem &PRadGEMSystem::operator =(PRadGEMSystem &&rhs)
     // release current resources
     Clear();
     delete gem_recon;
+    delete apv_pool;
 
     // move everything here
     gem_recon = rhs.gem_recon;
     rhs.gem_recon = nullptr;
+    apv_pool = rhs.apv_pool;
+    rhs.apv_pool = nullptr;
     PedestalMode = rhs.PedestalMode;
+    PedestalFitCheck = rhs.PedestalFitCheck;
     det_list = move(rhs.det_list);
     fec_list = move(rhs.fec_list);
     daq_slots = move(rhs.daq_slots);
@@ -180,6 +194,8 @@ void PRadGEMSystem::Configure(const string &path)
     def_cth = getDefConfig<float>("Default Common Mode Threshold", 20, verbose);
     def_zth = getDefConfig<float>("Default Zero Suppression Threshold", 5, verbose);
     def_ctth = getDefConfig<float>("Default Cross Talk Threshold", 8, verbose);
+    PedestalFitCheck = getDefConfig<bool>("Pedestal Fit Check", false, false);
+    SetAPVDecodeThreads(getDefConfig<unsigned int>("APV Decode Threads", 1, false));
 
     if(gem_recon)
         gem_recon->Configure(GetConfig<std::string>("GEM Cluster Configuration"));
@@ -540,6 +556,8 @@ const
 }
 
 // fill raw data to a certain apv
+// the hits go to the buffer of its FEC, a FEC is decoded by only one thread so
+// no lock is needed, call MergeHits at the end of event to move them to event
 void PRadGEMSystem::FillRawData(const GEMRawData &raw, EventData &event)
 {
     PRadGEMAPV *apv = GetAPV(raw.addr);
@@ -553,17 +571,73 @@ void PRadGEMSystem::FillRawData(const GEMRawData &raw, EventData &event)
                 apv->FillPedHist();
         } else {
             apv->ZeroSuppression();
-#ifdef MULTI_THREAD
-            locker.lock();
-#endif
-            apv->CollectZeroSupHits(event.get_gem_data());
-#ifdef MULTI_THREAD
-            locker.unlock();
-#endif
+            apv->CollectZeroSupHits(apv->GetFEC()->GetHitBuffer());
         }
     }
 }
 
+// fill all the APV frames from one GEM bank
+// the APVs are independent, so they can be decoded and zero suppressed in
+// parallel, the hits are then collected in the order of frames, so the result
+// is the same as filling the frames one by one
+void PRadGEMSystem::FillRawData(const vector<GEMRawData> &frames, EventData &event)
+{
+    // the workers have their own thread_local vectors, so they need to use
+    // a reference to the one of this thread
+    static thread_local vector<PRadGEMAPV*> apv_buffer;
+    vector<PRadGEMAPV*> &apvs = apv_buffer;
+    apvs.clear();
+
+    for(auto &raw : frames)
+        apvs.push_back(GetAPV(raw.addr));
+
+    bool monitor = event.is_monitor_event();
+    auto decode = [&] (size_t i)
+                  {
+                      PRadGEMAPV *apv = apvs[i];
+                      if(apv == nullptr)
+                          return;
+
+                      apv->FillRawData(frames[i].buf, frames[i].size);
+                      if(!monitor)
+                          apv->ZeroSuppression();
+                      else if(PedestalMode)
+                          apv->FillPedHist();
+                  };
+
+    if(apv_pool) {
+        apv_pool->Run(frames.size(), decode);
+    } else {
+        for(size_t i = 0; i < frames.size(); ++i)
+            decode(i);
+    }
+
+    if(monitor)
+        return;
+
+    for(auto &apv : apvs)
+    {
+        if(apv != nullptr)
+            apv->CollectZeroSupHits(apv->GetFEC()->GetHitBuffer());
+    }
+}
+
+// move the hits in FEC buffers to event, in the order of FEC id, so the
+// event data do not depend on how the ROC banks are decoded
+void PRadGEMSystem::MergeHits(EventData &event)
+{
+    auto &gem_data = event.get_gem_data();
+
+    for(auto &fec : fec_list)
+    {
+        auto &hits = fec->GetHitBuffer();
+        gem_data.insert(gem_data.end(),
+                        make_move_iterator(hits.begin()),
+                        make_move_iterator(hits.end()));
+        hits.clear();
+    }
+}
+
 // clear all APVs' raw data space
 void PRadGEMSystem::Reset()
 {
@@ -571,6 +645,7 @@ void PRadGEMSystem::Reset()
     {
         fec->APVControl(&PRadGEMAPV::ClearData);
         fec->APVControl(&PRadGEMAPV::ResetPedHist);
+        fec->GetHitBuffer().clear();
     }
 
     for(auto &det : det_list)
@@ -580,29 +655,34 @@ void PRadGEMSystem::Reset()
 }
 
 // fill zero suppressed data and re-collect these data in GEM_Data format
-void PRadGEMSystem::FillZeroSupData(const vector<GEMZeroSupData> &data_pack, EventData &event)
+// only the FECs in this data pack are touched, so the packs from different
+// ROCs can be handled at the same time, the hits go to the FEC buffers
+void PRadGEMSystem::FillZeroSupData(const vector<GEMZeroSupData> &data_pack, EventData &)
 {
-    // clear all the APVs' hits
+    vector<char> in_pack(daq_slots.size(), 0);
+    for(auto &data : data_pack)
+    {
+        if((uint32_t)data.addr.fec_id < in_pack.size())
+            in_pack[data.addr.fec_id] = 1;
+    }
+
+    // clear the APVs' hits
     for(auto &fec : fec_list)
     {
-        fec->APVControl(&PRadGEMAPV::ResetHitPos);
+        if(in_pack[fec->GetID()])
+            fec->APVControl(&PRadGEMAPV::ResetHitPos);
     }
 
     // fill in the online zero-suppressed data
     for(auto &data : data_pack)
         FillZeroSupData(data);
 
-#ifdef MULTI_THREAD
-        locker.lock();
-#endif
     // collect these zero-suppressed hits
     for(auto &fec : fec_list)
     {
-        fec->APVControl(&PRadGEMAPV::CollectZeroSupHits, event.get_gem_data());
+        if(in_pack[fec->GetID()])
+            fec->APVControl(&PRadGEMAPV::CollectZeroSupHits, fec->GetHitBuffer());
     }
-#ifdef MULTI_THREAD
-        locker.unlock();
-#endif
 }
 
 // fill zero suppressed data
@@ -618,10 +698,11 @@ void PRadGEMSystem::FillZeroSupData(const GEMZeroSupData &data)
 // update EventData to all APVs
 void PRadGEMSystem::ChooseEvent(const EventData &data)
 {
-    // clear all the APVs' hits
+    // clear all the APVs' hits, the APVs only reset the strips that have hits
+    // so there is no need to wipe the whole data buffer
     for(auto &fec : fec_list)
     {
-        fec->APVControl(&PRadGEMAPV::ClearData);
+        fec->APVControl(&PRadGEMAPV::ResetHitPos);
     }
 
     for(auto &hit : data.gem_data)
@@ -656,14 +737,51 @@ void PRadGEMSystem::Reconstruct()
     }
 }
 
-// fit pedestal for all APVs
-// this requires pedestal mode is on, otherwise there won't be any data to fit
+// update pedestal for all APVs
+// this requires pedestal mode is on, otherwise there won't be any data
 void PRadGEMSystem::FitPedestal()
 {
-    for(auto &fec : fec_list)
+    vector<PRadGEMAPV*> apv_list = GetAPVList();
+
+    // APVs are independent, the cross check fits are spread over workers, each
+    // worker has its own fit
+    PRadFitDriver driver(PedestalFitCheck ? 0 : 1);
+    vector<TF1*> fits;
+    for(unsigned int i = 0; i < driver.GetWorkers(); ++i)
     {
-        fec->APVControl(&PRadGEMAPV::FitPedestal);
+        string name = "apvfit_" + to_string(i);
+        fits.push_back(new TF1(name.c_str(), "gaus", 0, 8191));
     }
+
+    driver.Run(apv_list.size(),
+               [&] (size_t i, unsigned int worker, ostream &os)
+               {
+                   apv_list[i]->FitPedestal(PedestalFitCheck, os, fits[worker]);
+               });
+    driver.Flush();
+
+    for(auto &fit : fits)
+        delete fit;
+}
+
+// set the number of threads to decode the APVs of a GEM bank
+// 1 means no parallel decoding, 0 means using all the hardware threads
+void PRadGEMSystem::SetAPVDecodeThreads(unsigned int t)
+{
+    delete apv_pool, apv_pool = nullptr;
+
+    if(t == 1)
+        return;
+
+    apv_pool = new PRadTaskPool(t);
+    if(apv_pool->GetThreads() < 2)
+        delete apv_pool, apv_pool = nullptr;
+}
+
+unsigned int PRadGEMSystem::GetAPVDecodeThreads()
+const
+{
+    return apv_pool ? apv_pool->GetThreads() : 1;
 }
 
 // save pedestal file for all APVs
@@ -685,20 +803,24 @@ const
 }
 
 // set pedestal mode on/off
-// if the pedestal mode is on, filling raw data will also fill the histograms in
-// APV for future pedestal fitting
-// turn on the pedestal mode will greatly slow down the raw data handling and
-// consume a significant amount of memories
+// if the pedestal mode is on, filling raw data will also update the pedestal
+// estimators in APV, the estimators are reset when the mode is turned on
+// the histograms are only created if the fit cross check is enabled, it will
+// greatly slow down the raw data handling and consume a significant amount of
+// memories
 void PRadGEMSystem::SetPedestalMode(const bool &m)
 {
     PedestalMode = m;
 
     for(auto &fec : fec_list)
     {
-        if(m)
-            fec->APVControl(&PRadGEMAPV::CreatePedHist);
-        else
+        if(m) {
+            fec->APVControl(&PRadGEMAPV::ResetPedHist);
+            if(PedestalFitCheck)
+                fec->APVControl(&PRadGEMAPV::CreatePedHist);
+        } else {
             fec->APVControl(&PRadGEMAPV::ReleasePedHist);
+        }
     }
 }
 
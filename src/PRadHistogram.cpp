@@ -0,0 +1,233 @@
+//============================================================================//
+// A light weight histogram that only counts, with fixed bins                 //
+// The counters are atomic so it can be filled without a lock, and there can  //
+// be several copies (shards) of the counters so the threads filling the same //
+// histogram do not compete for the same cache line                           //
+// The ROOT histogram it holds is only updated when it is requested           //
+//============================================================================//
+
+#include "PRadHistogram.h"
+#include "TH1.h"
+#include "TAxis.h"
+#include <new>
+#include <utility>
+#include <cstdint>
+
+
+
+//============================================================================//
+// Constructors, Destructor, Assignment Operators                             //
+//============================================================================//
+
+// constructor
+PRadHistogram::PRadHistogram(TH1 *h, int s)
+: hist(h), shards(s), nbins_x(0), nbins_y(0),
+  min_x(0.), max_x(0.), min_y(0.), max_y(0.), nbins(0), stride(0),
+  buffer(nullptr), counters(nullptr), synced(-1)
+{
+    if(shards < 1)
+        shards = 1;
+
+    // only fixed bins are supported
+    if(hist) {
+        nbins_x = hist->GetXaxis()->GetNbins();
+        min_x = hist->GetXaxis()->GetXmin();
+        max_x = hist->GetXaxis()->GetXmax();
+        if(hist->GetDimension() > 1) {
+            nbins_y = hist->GetYaxis()->GetNbins();
+            min_y = hist->GetYaxis()->GetXmin();
+            max_y = hist->GetYaxis()->GetXmax();
+        }
+    }
+
+    reserve();
+}
+
+// copy constructor
+PRadHistogram::PRadHistogram(const PRadHistogram &that)
+: hist(nullptr), shards(that.shards), nbins_x(that.nbins_x), nbins_y(that.nbins_y),
+  min_x(that.min_x), max_x(that.max_x), min_y(that.min_y), max_y(that.max_y),
+  nbins(0), stride(0), buffer(nullptr), counters(nullptr), synced(-1)
+{
+    if(that.hist)
+        hist = (TH1*) that.hist->Clone();
+
+    reserve();
+
+    for(size_t i = 0; i < shards*stride; ++i)
+        counters[i].store(that.counters[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+}
+
+// move constructor
+PRadHistogram::PRadHistogram(PRadHistogram &&that)
+: hist(that.hist), shards(that.shards), nbins_x(that.nbins_x), nbins_y(that.nbins_y),
+  min_x(that.min_x), max_x(that.max_x), min_y(that.min_y), max_y(that.max_y),
+  nbins(that.nbins), stride(that.stride), buffer(that.buffer),
+  counters(that.counters), synced(that.synced)
+{
+    that.hist = nullptr;
+    that.buffer = nullptr;
+    that.counters = nullptr;
+    that.stride = 0;
+}
+
+// destructor
+PRadHistogram::~PRadHistogram()
+{
+    release();
+    delete hist;
+}
+
+// copy assignment operator
+PRadHistogram &PRadHistogram::operator =(const PRadHistogram &rhs)
+{
+    PRadHistogram that(rhs);
+    *this = std::move(that);
+    return *this;
+}
+
+// move assignment operator
+PRadHistogram &PRadHistogram::operator =(PRadHistogram &&rhs)
+{
+    release();
+    delete hist;
+
+    hist = rhs.hist;
+    shards = rhs.shards;
+    nbins_x = rhs.nbins_x;
+    nbins_y = rhs.nbins_y;
+    min_x = rhs.min_x;
+    max_x = rhs.max_x;
+    min_y = rhs.min_y;
+    max_y = rhs.max_y;
+    nbins = rhs.nbins;
+    stride = rhs.stride;
+    buffer = rhs.buffer;
+    counters = rhs.counters;
+    synced = rhs.synced;
+
+    rhs.hist = nullptr;
+    rhs.buffer = nullptr;
+    rhs.counters = nullptr;
+    rhs.stride = 0;
+    return *this;
+}
+
+
+
+//============================================================================//
+// Public Member Functions                                                    //
+//============================================================================//
+
+// reset all the counters and the ROOT histogram
+void PRadHistogram::Reset()
+{
+    for(size_t i = 0; i < shards*stride; ++i)
+        counters[i].store(0, std::memory_order_relaxed);
+
+    if(hist)
+        hist->Reset();
+
+    synced = 0;
+}
+
+// get the counts of a bin, merged from all the shards
+unsigned int PRadHistogram::GetBinCount(int bin)
+const
+{
+    if(bin < 0 || bin >= nbins)
+        return 0;
+
+    unsigned int count = 0;
+    for(int i = 0; i < shards; ++i)
+        count += counters[i*stride + bin].load(std::memory_order_relaxed);
+
+    return count;
+}
+
+// get the number of entries, merged from all the shards
+unsigned int PRadHistogram::GetEntries()
+const
+{
+    unsigned int entries = 0;
+    for(int i = 0; i < shards; ++i)
+        entries += counters[i*stride + nbins].load(std::memory_order_relaxed);
+
+    return entries;
+}
+
+// get the ROOT histogram, it is updated if there are new entries
+TH1 *PRadHistogram::GetHist()
+const
+{
+    if(hist && (long long)GetEntries() != synced)
+        sync();
+
+    return hist;
+}
+
+
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// allocate the counters for all shards, each shard starts at a new cache line
+void PRadHistogram::reserve()
+{
+    // underflow and overflow bins, and 1 more for entries
+    nbins = (nbins_x + 2)*((nbins_y > 0) ? (nbins_y + 2) : 1);
+
+    size_t per_line = HIST_ALIGNMENT/sizeof(Counter);
+    stride = (nbins + 1 + per_line - 1)/per_line*per_line;
+
+    size_t size = shards*stride;
+    buffer = new unsigned char[size*sizeof(Counter) + HIST_ALIGNMENT];
+
+    // align the address
+    size_t offset = HIST_ALIGNMENT - (uintptr_t)buffer%HIST_ALIGNMENT;
+    counters = reinterpret_cast<Counter*>(buffer + offset);
+
+    for(size_t i = 0; i < size; ++i)
+        new(counters + i) Counter(0);
+}
+
+void PRadHistogram::release()
+{
+    // atomic counters are trivially destructible
+    delete [] buffer, buffer = nullptr;
+    counters = nullptr;
+}
+
+// copy the merged counts to the ROOT histogram
+void PRadHistogram::sync()
+const
+{
+    // it can still be filled by other threads, the ROOT histogram will be
+    // updated again next time if there are more entries
+    synced = GetEntries();
+
+    // keep the fitted functions
+    hist->Reset("ICES");
+
+    unsigned int entries = 0;
+    for(int bin = 0; bin < nbins; ++bin)
+    {
+        unsigned int count = GetBinCount(bin);
+        if(count)
+            hist->SetBinContent(bin, count);
+        entries += count;
+    }
+
+    hist->SetEntries(entries);
+}
+
+// each thread gets an index when it first fills a histogram
+int PRadHistogram::thread_shard()
+{
+    static std::atomic<int> thread_count(0);
+    static thread_local int index = thread_count.fetch_add(1);
+
+    return index;
+}
@@ -9,16 +9,19 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include "PRadHyCalCluster.h"
 #include "PRadClusterProfile.h"
 
 
 const PRadClusterProfile &__hc_prof = PRadClusterProfile::Instance();
+static const std::vector<ModuleHit> __hc_no_hits;
 
 PRadHyCalCluster::PRadHyCalCluster()
 : depth_corr(true), leak_corr(true), linear_corr(true),
   log_weight_thres(3.6), min_cluster_energy(30.), min_center_energy(10.),
-  least_leak(0.05), linear_corr_limit(0.6), min_cluster_size(1), leak_iters(3)
+  least_leak(0.05), linear_corr_limit(0.6), min_cluster_size(1), leak_iters(3),
+  virt_neighbors(false)
 {
     // place holder
 }
@@ -66,6 +69,9 @@ void PRadHyCalCluster::ReadVModuleList(const std::string &path)
 
     inner_virtual.clear();
     outer_virtual.clear();
+    inner_neighbors.clear();
+    outer_neighbors.clear();
+    virt_neighbors = false;
 
     std::string name;
     std::string type, sector;
@@ -86,19 +92,63 @@ void PRadHyCalCluster::ReadVModuleList(const std::string &path)
         if(ConfigParser::str_upper(name) == "INNER") {
             ModuleHit inner_hit(false);
             inner_hit.id = -1;
-            inner_hit.geo = geo;
+            inner_hit.geo_index = PRadHyCalDetector::add_geometry(geo);
             inner_hit.sector = 0;
             inner_virtual.push_back(inner_hit);
         } else if(ConfigParser::str_upper(name) == "OUTER") {
             ModuleHit outer_hit(false);
             outer_hit.id = -1;
-            outer_hit.geo = geo;
+            outer_hit.geo_index = PRadHyCalDetector::add_geometry(geo);
             outer_hit.sector = 1;
             outer_virtual.push_back(outer_hit);
         }
     }
 }
 
+// find the virtual modules that can be reached by the profile from each module,
+// so the leakage correction only needs to go through these virtual modules
+void PRadHyCalCluster::BuildVirtualNeighbors(const std::vector<PRadHyCalModule*> &mlist)
+{
+    inner_neighbors.clear();
+    outer_neighbors.clear();
+
+    double max_size = 0.;
+    for(auto module : mlist)
+    {
+        const auto &geo = module->GetGeometry();
+        max_size = std::max(max_size, std::max(geo.size_x, geo.size_y));
+    }
+
+    for(auto module : mlist)
+    {
+        ModuleHit center(module, 0.);
+        if(TEST_BIT(center.flag, kInnerBound)) {
+            for(auto &vhit : inner_virtual)
+            {
+                if(__hc_prof.IsInRange(center, vhit, max_size))
+                    inner_neighbors[center.id].push_back(vhit);
+            }
+        }
+
+        if(TEST_BIT(center.flag, kOuterBound)) {
+            for(auto &vhit : outer_virtual)
+            {
+                if(__hc_prof.IsInRange(center, vhit, max_size))
+                    outer_neighbors[center.id].push_back(vhit);
+            }
+        }
+    }
+
+    virt_neighbors = true;
+}
+
+// build the lookup tables that depend on the module list, it needs to be
+// called after the method is configured and whenever the module list changes
+void PRadHyCalCluster::BuildModuleTables(const std::vector<PRadHyCalModule*> &mlist)
+{
+    BuildVirtualNeighbors(mlist);
+}
+
 void PRadHyCalCluster::FormCluster(std::vector<ModuleHit> &,
                                    std::vector<ModuleCluster> &)
 const
@@ -177,10 +227,10 @@ const
 
     // reconstruct position
     reconstructPos(cl, count, (BaseHit*)&hycal_hit);
-    hycal_hit.z = cluster.center.geo.z;
+    hycal_hit.z = cluster.center.GetZ();
 
     // z position will need a depth correction
-    hycal_hit.z += GetShowerDepth(cluster.center.geo.type, cluster.energy);
+    hycal_hit.z += GetShowerDepth(cluster.center.GetType(), cluster.energy);
 
     return hycal_hit;
 }
@@ -196,10 +246,10 @@ const
         AddVirtHits(cluster, dead);
 
     if(TEST_BIT(cluster.center.flag, kInnerBound))
-        AddVirtHits(cluster, inner_virtual);
+        AddVirtHits(cluster, virtualNeighbors(cluster.center, true));
 
     if(TEST_BIT(cluster.center.flag, kOuterBound))
-        AddVirtHits(cluster, outer_virtual);
+        AddVirtHits(cluster, virtualNeighbors(cluster.center, false));
 }
 
 // add virtual hits to correct energy leakage
@@ -212,7 +262,7 @@ const
     const auto &center = cluster.center;
 
     // temp container to reconstruct position
-    BaseHit cl[POS_RECON_HITS], temp_hit(center.geo.x, center.geo.y, 0., cluster.energy);
+    BaseHit cl[POS_RECON_HITS], temp_hit(center.GetX(), center.GetY(), 0., cluster.energy);
 
     // estimator to check if virtual hits will improve the profile
     float estimator = __hc_prof.EvalEstimator(temp_hit, cluster);
@@ -253,8 +303,8 @@ const
 
             const auto &hit = dead.at(i);
             if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-                cl[count].x = hit.geo.x;
-                cl[count].y = hit.geo.y;
+                cl[count].x = hit.GetX();
+                cl[count].y = hit.GetY();
                 cl[count].E = temp_energy[i];
                 temp_hit.E += temp_energy[i];
                 count++;
@@ -295,6 +345,22 @@ const
     }
 }
 
+// get the virtual modules for the leakage correction of a module, all the
+// virtual modules are used if the lists are not built for the module list
+const std::vector<ModuleHit> &PRadHyCalCluster::virtualNeighbors(const ModuleHit &center,
+                                                                 bool inner)
+const
+{
+    if(!virt_neighbors)
+        return inner ? inner_virtual : outer_virtual;
+
+    const auto &neighbors = inner ? inner_neighbors : outer_neighbors;
+    auto it = neighbors.find(center.id);
+    if(it == neighbors.end())
+        return __hc_no_hits;
+    return it->second;
+}
+
 // only use the center 3x3 to fill the temp container
 inline int PRadHyCalCluster::fillHits(BaseHit *temp,
                                       const ModuleHit &center,
@@ -305,8 +371,9 @@ const
     for(auto &hit : hits)
     {
         if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-            temp[count].x = hit.geo.x;
-            temp[count].y = hit.geo.y;
+            const auto &geo = hit.GetGeometry();
+            temp[count].x = geo.x;
+            temp[count].y = geo.y;
             temp[count].E = hit.energy;
             count++;
         }
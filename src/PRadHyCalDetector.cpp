@@ -7,6 +7,7 @@
 
 #include "PRadHyCalDetector.h"
 #include "PRadHyCalSystem.h"
+#include "PRadClusterProfile.h"
 #include "TH1.h"
 #include <algorithm>
 #include <fstream>
@@ -15,6 +16,71 @@
 
 // enum name lists
 static const char *__hycal_sector_list[] = {"Center", "Top", "Right", "Bottom", "Left"};
+static const std::vector<ModuleHit> __hycal_no_hits;
+
+// geometry table shared by all the hits
+PRadHyCalDetector::GeometryTable PRadHyCalDetector::geo_table;
+
+
+
+//============================================================================//
+// Geometry table                                                             //
+//============================================================================//
+
+PRadHyCalDetector::GeometryTable::GeometryTable()
+: entries(0)
+{
+    for(auto &chunk : chunks)
+        chunk.store(nullptr, std::memory_order_relaxed);
+
+    Add(PRadHyCalModule::Geometry());
+}
+
+PRadHyCalDetector::GeometryTable::~GeometryTable()
+{
+    for(auto &chunk : chunks)
+        delete [] chunk.load(std::memory_order_relaxed);
+}
+
+// add a geometry and return its index, same geometries share one entry
+unsigned int PRadHyCalDetector::GeometryTable::Add(const PRadHyCalModule::Geometry &geo)
+{
+    std::lock_guard<std::mutex> lock(locker);
+
+    Key key(geo.type, geo.size_x, geo.size_y, geo.size_z, geo.x, geo.y, geo.z);
+    auto it = index_map.find(key);
+    if(it != index_map.end())
+        return it->second;
+
+    unsigned int idx = entries.load(std::memory_order_relaxed);
+    if(idx == UINT32_MAX)
+        throw PRadException("PRad HyCal Detector Error", "Geometry table is full!");
+
+    // a new chunk is needed when the index is the first one of a chunk
+    uint64_t pos = (uint64_t)idx + (1ull << GEOMETRY_CHUNK_BITS);
+    int chunk = 63 - __builtin_clzll(pos) - GEOMETRY_CHUNK_BITS;
+    pos -= (1ull << (GEOMETRY_CHUNK_BITS + chunk));
+    PRadHyCalModule::Geometry *entry = chunks[chunk].load(std::memory_order_relaxed);
+    if(entry == nullptr) {
+        entry = new PRadHyCalModule::Geometry[1ull << (GEOMETRY_CHUNK_BITS + chunk)];
+        chunks[chunk].store(entry, std::memory_order_release);
+    }
+
+    entry[pos] = geo;
+    index_map.emplace(key, idx);
+    entries.store(idx + 1, std::memory_order_release);
+    return idx;
+}
+
+// get the geometry at index
+PRadHyCalModule::Geometry PRadHyCalDetector::GeometryTable::Get(unsigned int idx)
+const
+{
+    if(idx >= Size())
+        return PRadHyCalModule::Geometry();
+
+    return At(idx);
+}
 
 
 
@@ -24,7 +90,8 @@ static const char *__hycal_sector_list[] = {"Center", "Top", "Right", "Bottom",
 
 // constructor
 PRadHyCalDetector::PRadHyCalDetector(const std::string &det, PRadHyCalSystem *sys)
-: PRadDetector(det), system(sys)
+: PRadDetector(det), system(sys), grid_x0(0.), grid_y0(0.), grid_step(1.),
+  grid_nx(0), grid_ny(0)
 {
     // place holder
 }
@@ -34,13 +101,17 @@ PRadHyCalDetector::PRadHyCalDetector(const std::string &det, PRadHyCalSystem *sy
 // copy constructor
 PRadHyCalDetector::PRadHyCalDetector(const PRadHyCalDetector &that)
 : PRadDetector(that), system(nullptr), module_hits(that.module_hits),
-  dead_hits(that.dead_hits), module_clusters(that.module_clusters),
+  dead_hits(that.dead_hits), dead_neighbors(that.dead_neighbors),
+  module_clusters(that.module_clusters),
   hycal_hits(that.hycal_hits)
 {
     for(auto module : that.module_list)
     {
         AddModule(new PRadHyCalModule(*module));
     }
+
+    // modules are added in the same order
+    buildModuleGrid();
 }
 
 // move constructor
@@ -48,7 +119,11 @@ PRadHyCalDetector::PRadHyCalDetector(PRadHyCalDetector &&that)
 : PRadDetector(that), system(nullptr), module_list(std::move(that.module_list)),
   id_map(std::move(that.id_map)), name_map(std::move(that.name_map)),
   module_hits(std::move(that.module_hits)), dead_hits(std::move(that.dead_hits)),
-  module_clusters(std::move(that.module_clusters)), hycal_hits(std::move(that.hycal_hits))
+  dead_neighbors(std::move(that.dead_neighbors)),
+  module_clusters(std::move(that.module_clusters)), hycal_hits(std::move(that.hycal_hits)),
+  grid_x0(that.grid_x0), grid_y0(that.grid_y0), grid_step(that.grid_step),
+  grid_nx(that.grid_nx), grid_ny(that.grid_ny),
+  grid_offset(std::move(that.grid_offset)), grid_modules(std::move(that.grid_modules))
 {
     // reset the connections between module and HyCal
     for(auto module : module_list)
@@ -86,8 +161,16 @@ PRadHyCalDetector &PRadHyCalDetector::operator =(PRadHyCalDetector &&rhs)
     name_map = std::move(rhs.name_map);
     module_hits = std::move(rhs.module_hits);
     dead_hits = std::move(rhs.dead_hits);
+    dead_neighbors = std::move(rhs.dead_neighbors);
     module_clusters = std::move(rhs.module_clusters);
     hycal_hits = std::move(rhs.hycal_hits);
+    grid_x0 = rhs.grid_x0;
+    grid_y0 = rhs.grid_y0;
+    grid_step = rhs.grid_step;
+    grid_nx = rhs.grid_nx;
+    grid_ny = rhs.grid_ny;
+    grid_offset = std::move(rhs.grid_offset);
+    grid_modules = std::move(rhs.grid_modules);
 
     for(auto module : module_list)
         module->SetDetector(this);
@@ -211,6 +294,9 @@ void PRadHyCalDetector::ReadCalibrationFile(const std::string &path)
                       << std::endl;
         }
     }
+    // calibration constants changed, inform the system
+    if(system)
+        system->UpdateEnergyTable();
 }
 
 void PRadHyCalDetector::SaveModuleList(const std::string &path)
@@ -269,6 +355,9 @@ bool PRadHyCalDetector::AddModule(PRadHyCalModule *module)
     name_map[name] = module;
     id_map[id] = module;
 
+    // grid needs to be rebuilt, it will be done by sorting the module list
+    clearModuleGrid();
+
     return true;
 }
 
@@ -298,6 +387,9 @@ void PRadHyCalDetector::RemoveModule(PRadHyCalModule *module)
     module_list.clear();
     for(auto &it : id_map)
         module_list.push_back(it.second);
+
+    // the list is complete, so is the grid
+    buildModuleGrid();
 }
 
 // disconnect module
@@ -326,6 +418,9 @@ void PRadHyCalDetector::DisconnectModule(PRadHyCalModule *module, bool force_dis
     module_list.clear();
     for(auto &it : id_map)
         module_list.push_back(it.second);
+
+    // the list is complete, so is the grid
+    buildModuleGrid();
 }
 
 void PRadHyCalDetector::SortModuleList()
@@ -335,6 +430,15 @@ void PRadHyCalDetector::SortModuleList()
              {
                 return *m1 < *m2;
              });
+
+    // the search grid keeps the module list order
+    buildModuleGrid();
+}
+
+// rebuild the search grid, it is needed after a module changed its geometry
+void PRadHyCalDetector::UpdateModuleGrid()
+{
+    buildModuleGrid();
 }
 
 void PRadHyCalDetector::ClearModuleList()
@@ -349,6 +453,7 @@ void PRadHyCalDetector::ClearModuleList()
     module_list.clear();
     id_map.clear();
     name_map.clear();
+    clearModuleGrid();
 }
 
 void PRadHyCalDetector::OutputModuleList(std::ostream &os)
@@ -370,6 +475,7 @@ void PRadHyCalDetector::CreateDeadHits()
 {
     // clear current dead hits
     dead_hits.clear();
+    dead_neighbors.clear();
 
     // create dead hits
     for(auto module : module_list)
@@ -386,14 +492,18 @@ void PRadHyCalDetector::CreateDeadHits()
 
     // check if any modules are very close to this dead module, and set a bit
     // for the future correction
+    double max_size = 0.;
     for(auto module : module_list)
     {
         const auto &geo = module->GetGeometry();
+        CLEAR_BIT(module->layout.flag, kDeadNeighbor);
+        max_size = std::max(max_size, std::max(geo.size_x, geo.size_y));
 
         for(auto &dead : dead_hits)
         {
-            float dx = (geo.x - dead.geo.x)/(geo.size_x + dead.geo.size_x);
-            float dy = (geo.y - dead.geo.y)/(geo.size_y + dead.geo.size_y);
+            const auto &dgeo = dead.GetGeometry();
+            float dx = (geo.x - dgeo.x)/(geo.size_x + dgeo.size_x);
+            float dy = (geo.y - dgeo.y)/(geo.size_y + dgeo.size_y);
 
             if(sqrt(dx*dx + dy*dy)*2. < CORNER_ADJACENT)
             {
@@ -402,6 +512,22 @@ void PRadHyCalDetector::CreateDeadHits()
             }
         }
     }
+
+    // save the dead modules that can be reached by the profile from these
+    // modules, so the correction does not need to go through all dead modules
+    const PRadClusterProfile &profile = PRadClusterProfile::Instance();
+    for(auto module : module_list)
+    {
+        if(!TEST_BIT(module->layout.flag, kDeadNeighbor))
+            continue;
+
+        ModuleHit center(module, 0.);
+        for(auto &dead : dead_hits)
+        {
+            if(profile.IsInRange(center, dead, max_size))
+                dead_neighbors[center.id].push_back(dead);
+        }
+    }
 }
 
 // hits/clusters reconstruction
@@ -420,7 +546,7 @@ void PRadHyCalDetector::Reconstruct(PRadHyCalCluster *method)
             continue;
 
         // leakage correction for dead modules
-        method->LeakCorr(cluster, dead_hits);
+        method->LeakCorr(cluster, GetDeadNeighbors(cluster.center.id));
 
         // the center module does not exist should be a fatal problem, thus no
         // safety check here
@@ -461,6 +587,16 @@ void PRadHyCalDetector::ClearHits()
     module_hits.clear();
 }
 
+// get the dead modules for the leakage correction of a module
+const std::vector<ModuleHit> &PRadHyCalDetector::GetDeadNeighbors(const int &id)
+const
+{
+    auto it = dead_neighbors.find(id);
+    if(it == dead_neighbors.end())
+        return __hycal_no_hits;
+    return it->second;
+}
+
 PRadHyCalModule *PRadHyCalDetector::GetModule(const int &id)
 const
 {
@@ -482,6 +618,10 @@ const
 PRadHyCalModule *PRadHyCalDetector::GetModule(const float &x, const float &y)
 const
 {
+    if(!grid_modules.empty())
+        return gridSearch(x, y);
+
+    // no grid available, scan all modules
     for(auto &module : module_list)
     {
         float pos_x = module->GetX();
@@ -490,7 +630,7 @@ const
             continue;
         float pos_y = module->GetY();
         float size_y = module->GetSizeY();
-        if((y > pos_y + size_y/2.) || (y < pos_y - size_x/2.))
+        if((y > pos_y + size_y/2.) || (y < pos_y - size_y/2.))
             continue;
 
         return module;
@@ -582,17 +722,135 @@ const
     module.SetLayout(PRadHyCalModule::Layout(flag, sector, row-1, col-1));
 }
 
+// build the uniform grid for module searching by position
+void PRadHyCalDetector::buildModuleGrid()
+{
+    clearModuleGrid();
+
+    if(module_list.empty())
+        return;
+
+    // determine the grid range and the cell size
+    double x_min = module_list.front()->GetX(), x_max = x_min;
+    double y_min = module_list.front()->GetY(), y_max = y_min;
+    grid_step = module_list.front()->GetSizeX();
+    for(auto &module : module_list)
+    {
+        const auto &geo = module->GetGeometry();
+        x_min = std::min(x_min, geo.x - geo.size_x/2.);
+        x_max = std::max(x_max, geo.x + geo.size_x/2.);
+        y_min = std::min(y_min, geo.y - geo.size_y/2.);
+        y_max = std::max(y_max, geo.y + geo.size_y/2.);
+        grid_step = std::min(grid_step, std::min(geo.size_x, geo.size_y));
+    }
+
+    if(grid_step <= 0.) {
+        std::cout << "PRad HyCal Detector Warning: Found module with zero size, "
+                  << "module search by position will not use a grid."
+                  << std::endl;
+        return;
+    }
+
+    grid_x0 = x_min;
+    grid_y0 = y_min;
+    grid_nx = int((x_max - x_min)/grid_step) + 1;
+    grid_ny = int((y_max - y_min)/grid_step) + 1;
+
+    // cell range of a module, it is slightly enlarged so the boundary check in
+    // single precision won't miss it
+    auto cell_range = [this] (const PRadHyCalModule::Geometry &geo,
+                              int &ix1, int &ix2, int &iy1, int &iy2)
+                      {
+                          const double margin = 1e-3;
+                          ix1 = std::max(0, int((geo.x - geo.size_x/2. - margin - grid_x0)/grid_step));
+                          ix2 = std::min(grid_nx - 1, int((geo.x + geo.size_x/2. + margin - grid_x0)/grid_step));
+                          iy1 = std::max(0, int((geo.y - geo.size_y/2. - margin - grid_y0)/grid_step));
+                          iy2 = std::min(grid_ny - 1, int((geo.y + geo.size_y/2. + margin - grid_y0)/grid_step));
+                      };
+
+    // count modules in each cell, then fill them in
+    std::vector<unsigned int> counts(grid_nx*grid_ny, 0);
+    int ix1, ix2, iy1, iy2;
+    for(auto &module : module_list)
+    {
+        cell_range(module->GetGeometry(), ix1, ix2, iy1, iy2);
+        for(int iy = iy1; iy <= iy2; ++iy)
+            for(int ix = ix1; ix <= ix2; ++ix)
+                counts[iy*grid_nx + ix]++;
+    }
+
+    grid_offset.resize(counts.size() + 1);
+    grid_offset[0] = 0;
+    for(size_t i = 0; i < counts.size(); ++i)
+        grid_offset[i + 1] = grid_offset[i] + counts[i];
+
+    grid_modules.resize(grid_offset.back());
+    for(size_t i = 0; i < counts.size(); ++i)
+        counts[i] = grid_offset[i];
+
+    for(auto &module : module_list)
+    {
+        cell_range(module->GetGeometry(), ix1, ix2, iy1, iy2);
+        for(int iy = iy1; iy <= iy2; ++iy)
+            for(int ix = ix1; ix <= ix2; ++ix)
+                grid_modules[counts[iy*grid_nx + ix]++] = module;
+    }
+}
+
+void PRadHyCalDetector::clearModuleGrid()
+{
+    grid_nx = 0;
+    grid_ny = 0;
+    grid_offset.clear();
+    grid_modules.clear();
+}
+
+// only check the modules that overlap with the cell containing the point
+PRadHyCalModule *PRadHyCalDetector::gridSearch(const float &x, const float &y)
+const
+{
+    double fx = (x - grid_x0)/grid_step;
+    double fy = (y - grid_y0)/grid_step;
+    if(fx < 0. || fy < 0. || fx >= grid_nx || fy >= grid_ny)
+        return nullptr;
+
+    int cell = int(fy)*grid_nx + int(fx);
+    for(unsigned int i = grid_offset[cell]; i < grid_offset[cell + 1]; ++i)
+    {
+        PRadHyCalModule *module = grid_modules[i];
+        float pos_x = module->GetX();
+        float size_x = module->GetSizeX();
+        if((x > pos_x + size_x/2.) || (x < pos_x - size_x/2.))
+            continue;
+        float pos_y = module->GetY();
+        float size_y = module->GetSizeY();
+        if((y > pos_y + size_y/2.) || (y < pos_y - size_y/2.))
+            continue;
+
+        return module;
+    }
+
+    return nullptr;
+}
+
 // quantize the distance between two modules by there sizes
 // by this way we can indiscriminately check modules with different size
 // only useful for adjacent module checking
 float PRadHyCalDetector::hit_distance(const ModuleHit &m1, const ModuleHit &m2)
 {
-    float dx = (m1.geo.x - m2.geo.x)/(m1.geo.size_x + m2.geo.size_x);
-    float dy = (m1.geo.y - m2.geo.y)/(m1.geo.size_y + m2.geo.size_y);
+    const auto &g1 = m1.GetGeometry(), &g2 = m2.GetGeometry();
+    float dx = (g1.x - g2.x)/(g1.size_x + g2.size_x);
+    float dy = (g1.y - g2.y)/(g1.size_y + g2.size_y);
 
     return sqrt(dx*dx + dy*dy)*2.;
 }
 
+// register a geometry in the table, return its index for the hits
+unsigned int PRadHyCalDetector::add_geometry(const PRadHyCalModule::Geometry &geo)
+{
+    return geo_table.Add(geo);
+}
+
 // get enum HyCalSector by its name
 int PRadHyCalDetector::get_sector_id(const char *name)
 {
@@ -26,13 +26,15 @@ static const char *__module_type_list[] = {"PbGlass", "PbWO4"};
 PRadHyCalModule::PRadHyCalModule(const std::string &n,
                                  const Geometry &geo,
                                  PRadHyCalDetector *det)
-: detector(det), daq_ch(nullptr), name(n), geometry(geo)
+: detector(det), daq_ch(nullptr), name(n), geometry(geo),
+  geo_index(PRadHyCalDetector::add_geometry(geo))
 {
     id = name_to_primex_id(n);
 }
 
 PRadHyCalModule::PRadHyCalModule(int pid, const Geometry &geo, PRadHyCalDetector *det)
-: detector(det), daq_ch(nullptr), id(pid), geometry(geo)
+: detector(det), daq_ch(nullptr), id(pid), geometry(geo),
+  geo_index(PRadHyCalDetector::add_geometry(geo))
 {
     if(geo.type == PbGlass)
         name = "G";
@@ -45,7 +47,8 @@ PRadHyCalModule::PRadHyCalModule(int pid, const Geometry &geo, PRadHyCalDetector
 // copy constructor
 PRadHyCalModule::PRadHyCalModule(const PRadHyCalModule &that)
 : detector(nullptr), daq_ch(nullptr), name(that.name), id(that.id),
-  geometry(that.geometry), layout(that.layout), cal_const(that.cal_const)
+  geometry(that.geometry), geo_index(that.geo_index), layout(that.layout),
+  cal_const(that.cal_const)
 {
     // place holder
 }
@@ -53,7 +56,8 @@ PRadHyCalModule::PRadHyCalModule(const PRadHyCalModule &that)
 // move constructor
 PRadHyCalModule::PRadHyCalModule(PRadHyCalModule &&that)
 : detector(nullptr), daq_ch(nullptr), name(std::move(that.name)), id(that.id),
-  geometry(that.geometry), layout(that.layout), cal_const(that.cal_const)
+  geometry(that.geometry), geo_index(that.geo_index), layout(that.layout),
+  cal_const(that.cal_const)
 {
     // place holder
 }
@@ -71,6 +75,7 @@ PRadHyCalModule &PRadHyCalModule::operator =(const PRadHyCalModule &rhs)
     name = rhs.name;
     id = rhs.id;
     geometry = rhs.geometry;
+    geo_index = rhs.geo_index;
     cal_const = rhs.cal_const;
     return *this;
 }
@@ -80,6 +85,7 @@ PRadHyCalModule &PRadHyCalModule::operator =(PRadHyCalModule &&rhs)
     name = std::move(rhs.name);
     id = rhs.id;
     geometry = rhs.geometry;
+    geo_index = rhs.geo_index;
     cal_const = std::move(rhs.cal_const);
     return *this;
 }
@@ -112,6 +118,17 @@ void PRadHyCalModule::UnsetDetector(bool force_unset)
     detector = nullptr;
 }
 
+// set geometry, it is also registered in the geometry table for the hits
+void PRadHyCalModule::SetGeometry(const Geometry &geo)
+{
+    geometry = geo;
+    geo_index = PRadHyCalDetector::add_geometry(geo);
+
+    // the position search of the detector depends on the geometry
+    if(detector)
+        detector->UpdateModuleGrid();
+}
+
 // set daq channel
 void PRadHyCalModule::SetChannel(PRadADCChannel *ch, bool force_set)
 {
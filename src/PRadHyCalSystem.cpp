@@ -8,6 +8,7 @@
 
 #include "PRadHyCalSystem.h"
 #include "PRadHyCalCluster.h"
+#include "PRadFitDriver.h"
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
@@ -23,21 +24,21 @@
 
 // constructor
 PRadHyCalSystem::PRadHyCalSystem(const std::string &path)
-: hycal(new PRadHyCalDetector("HyCal", this)), recon(nullptr)
+: hycal(new PRadHyCalDetector("HyCal", this)), recon(nullptr),
+  ped_fit_check(false)
 {
     // reserve enough buckets for the adc maps
     adc_addr_map.reserve(ADC_BUCKETS);
     adc_name_map.reserve(ADC_BUCKETS);
 
-    // initialize energy histogram
-    energy_hist = new TH1D("HyCal Energy", "Total Energy (MeV)", 2000, 0, 2500);
+    // initialize energy histogram, it is filled once per event and possibly
+    // from several threads, so give it a few shards
+    energy_hist = new PRadHistogram(new TH1D("HyCal Energy", "Total Energy (MeV)", 2000, 0, 2500), 4);
 
     // hycal clustering methods
     AddClusterMethod("Square", new PRadSquareCluster());
     AddClusterMethod("Island", new PRadIslandCluster());
-#ifdef USE_PRIMEX_METHOD
     AddClusterMethod("Primex", new PRadPrimexCluster());
-#endif
     if(!path.empty())
         Configure(path);
 }
@@ -46,7 +47,7 @@ PRadHyCalSystem::PRadHyCalSystem(const std::string &path)
 // it does not only copy the members, but also copy the connections between the
 // members
 PRadHyCalSystem::PRadHyCalSystem(const PRadHyCalSystem &that)
-: ConfigObject(that), hycal(nullptr)
+: ConfigObject(that), hycal(nullptr), ped_fit_check(that.ped_fit_check)
 {
     // copy detector
     if(that.hycal) {
@@ -55,7 +56,7 @@ PRadHyCalSystem::PRadHyCalSystem(const PRadHyCalSystem &that)
     }
 
     // copy histogram
-    energy_hist = new TH1D(*that.energy_hist);
+    energy_hist = new PRadHistogram(*that.energy_hist);
 
     // copy reconstruction method
     for(auto &it : that.recon_map)
@@ -92,6 +93,7 @@ PRadHyCalSystem::PRadHyCalSystem(PRadHyCalSystem &&that)
   adc_list(std::move(that.adc_list)), tdc_list(std::move(that.tdc_list)),
   adc_addr_map(std::move(that.adc_addr_map)), adc_name_map(std::move(that.adc_name_map)),
   tdc_addr_map(std::move(that.tdc_addr_map)), tdc_name_map(std::move(that.tdc_name_map)),
+  ch_ped(std::move(that.ch_ped)), ch_gain(std::move(that.ch_gain)),
   recon_map(std::move(that.recon_map))
 {
     hycal = that.hycal;
@@ -103,6 +105,7 @@ PRadHyCalSystem::PRadHyCalSystem(PRadHyCalSystem &&that)
 
     energy_hist = that.energy_hist;
     that.energy_hist = nullptr;
+    ped_fit_check = that.ped_fit_check;
 }
 
 // destructor
@@ -142,6 +145,7 @@ PRadHyCalSystem &PRadHyCalSystem::operator =(PRadHyCalSystem &&rhs)
     rhs.recon = nullptr;
     energy_hist = rhs.energy_hist;
     rhs.energy_hist = nullptr;
+    ped_fit_check = rhs.ped_fit_check;
 
     adc_list = std::move(rhs.adc_list);
     tdc_list = std::move(rhs.tdc_list);
@@ -149,6 +153,8 @@ PRadHyCalSystem &PRadHyCalSystem::operator =(PRadHyCalSystem &&rhs)
     adc_name_map = std::move(rhs.adc_name_map);
     tdc_addr_map = std::move(rhs.tdc_addr_map);
     tdc_name_map = std::move(rhs.tdc_name_map);
+    ch_ped = std::move(rhs.ch_ped);
+    ch_gain = std::move(rhs.ch_gain);
     recon_map = std::move(rhs.recon_map);
 
     return *this;
@@ -174,6 +180,7 @@ void PRadHyCalSystem::Configure(const std::string &path)
     ReadChannelList(GetConfig<std::string>("DAQ Channel List"));
 
     ReadRunInfoFile(GetConfig<std::string>("Run Info File"));
+    ped_fit_check = getDefConfig<bool>("Pedestal Fit Check", false, false);
 
     // reconstruction configuration
     SetClusterMethod(GetConfig<std::string>("Cluster Method"));
@@ -181,20 +188,30 @@ void PRadHyCalSystem::Configure(const std::string &path)
         recon->Configure(GetConfig<std::string>("Cluster Configuration"));
 
     // load profile
+    PRadClusterProfile &profile = PRadClusterProfile::Instance();
+    // quantized profile uses half of the memory, with 16 bit precision
+    profile.SetQuantized(getDefConfig<bool>("Quantized Profile", false, false));
     std::string pwo_prof, lg_prof;
     pwo_prof = GetConfig<std::string>("Lead Tungstate Profile");
-    PRadClusterProfile::Instance().LoadProfile((int)PRadHyCalModule::PbWO4, pwo_prof);
+    profile.LoadProfile((int)PRadHyCalModule::PbWO4, pwo_prof);
     lg_prof = GetConfig<std::string>("Lead Glass Profile");
-    PRadClusterProfile::Instance().LoadProfile((int)PRadHyCalModule::PbGlass, lg_prof);
+    profile.LoadProfile((int)PRadHyCalModule::PbGlass, lg_prof);
+    // module pairs across the PbWO4/PbGlass boundary
+    if(hycal)
+        profile.BuildTransitionTable(hycal->GetModuleList());
+
+    // lookup tables of the cluster methods from the module list
+    if(hycal) {
+        for(auto &it : recon_map)
+            it.second->BuildModuleTables(hycal->GetModuleList());
+    }
 
-#ifdef USE_PRIMEX_METHOD
-    // original primex method needs to load the profile into fortran coe
+    // primex method keeps its own profile tables, the same as the fortran code
     PRadPrimexCluster *method = static_cast<PRadPrimexCluster*>(GetClusterMethod("Primex"));
     if(method) {
         method->LoadCrystalProfile(pwo_prof);
         method->LoadLeadGlassProfile(lg_prof);
     }
-#endif
 }
 
 // read DAQ channel list
@@ -321,6 +338,8 @@ void PRadHyCalSystem::BuildConnections()
         adc->SetModule(module);
         module->SetChannel(adc);
     }
+
+    UpdateEnergyTable();
 }
 
 // read module status file
@@ -400,13 +419,14 @@ void PRadHyCalSystem::ReadRunInfoFile(const std::string &path)
     if(hycal)
         hycal->CreateDeadHits();
 
-#ifdef USE_PRIMEX_METHOD
-    // original primex method needs to load the profile into fortran coe
+    // pedestals and gains are changed
+    UpdateEnergyTable();
+
+    // primex method needs the module status for the neighbors of the clusters
     PRadPrimexCluster *method = static_cast<PRadPrimexCluster*>(GetClusterMethod("Primex"));
     if(method && hycal) {
         method->UpdateModuleStatus(hycal->GetModuleList());
     }
-#endif
 }
 
 // update the event info to DAQ system
@@ -508,6 +528,8 @@ void PRadHyCalSystem::SetDetector(PRadHyCalDetector *h)
 
     if(hycal)
         hycal->SetSystem(this);
+
+    UpdateEnergyTable();
 }
 
 // remove current detector
@@ -517,6 +539,8 @@ void PRadHyCalSystem::RemoveDetector()
         hycal->UnsetSystem(true);
         delete hycal, hycal = nullptr;
     }
+
+    UpdateEnergyTable();
 }
 
 void PRadHyCalSystem::DisconnectDetector(bool force_disconn)
@@ -526,6 +550,8 @@ void PRadHyCalSystem::DisconnectDetector(bool force_disconn)
             hycal->UnsetSystem(true);
         hycal = nullptr;
     }
+
+    UpdateEnergyTable();
 }
 
 // add adc channel
@@ -552,6 +578,9 @@ bool PRadHyCalSystem::AddADCChannel(PRadADCChannel *adc)
     adc_list.push_back(adc);
     adc_name_map[adc->GetName()] = adc;
     adc_addr_map[adc->GetAddress()] = adc;
+    ch_ped.push_back(adc->GetPedestal().mean);
+    ch_gain.push_back(adc->GetModule() ?
+                      adc->GetModule()->GetCalibConst().GetCalibConst() : 0.);
     return true;
 }
 
@@ -589,6 +618,8 @@ void PRadHyCalSystem::ClearADCChannel()
     adc_list.clear();
     adc_name_map.clear();
     adc_addr_map.clear();
+    ch_ped.clear();
+    ch_gain.clear();
 }
 
 void PRadHyCalSystem::ClearTDCChannel()
@@ -689,39 +720,28 @@ void PRadHyCalSystem::Sparsify(const EventData &event)
 double PRadHyCalSystem::GetEnergy(const EventData &event)
 const
 {
-    double energy = 0.;
-    for(auto &adc : event.adc_data)
-    {
-        if(adc.channel_id >= adc_list.size())
-            continue;
-
-        energy += adc_list[adc.channel_id]->GetEnergy(adc.value);
-    }
-
-    return energy;
+    return sumEnergy(event.adc_data);
 }
 
 // histogram manipulation
+// the adc channels estimate the pedestals while filling, the events need to be
+// filled by one thread at a time (the data handler fills in its event thread)
 void PRadHyCalSystem::FillHists(const EventData &event)
 {
-    double energy = 0.;
-
     // adc hists for all types of events
     for(auto &adc : event.get_adc_data())
     {
         if(adc.channel_id >= adc_list.size())
             continue;
 
-        PRadADCChannel *channel = adc_list.at(adc.channel_id);
-        channel->FillHist(adc.value, event.get_trigger());
-        energy += channel->GetEnergy(adc.value);
+        adc_list[adc.channel_id]->FillHist(adc.value, event.get_trigger());
     }
 
     // energy and tdc for only physics events
     if(!event.is_physics_event())
         return;
 
-    energy_hist->Fill(energy);
+    energy_hist->Fill(sumEnergy(event.get_adc_data()));
 
     for(auto &tdc : event.get_tdc_data())
     {
@@ -872,7 +892,7 @@ const
 {
     TFile f(path.c_str(), "recreate");
 
-    energy_hist->Write();
+    energy_hist->GetHist()->Write();
 
     // tdc hists
     TDirectory *cur_dir = f.mkdir("TDC Histograms");
@@ -997,23 +1017,62 @@ throw(PRadException)
     return result;
 }
 
+// update pedestals from the estimators filled by the pedestal events, the
+// gaussian fits on pedestal histograms are only done as a cross check
 void PRadHyCalSystem::FitPedestal()
 {
-    for(auto &channel : adc_list)
+    // the cross check fits are independent, spread them over workers, each
+    // worker has its own fit
+    PRadFitDriver driver(ped_fit_check ? 0 : 1);
+    std::vector<TF1*> fits;
+    for(unsigned int i = 0; i < driver.GetWorkers(); ++i)
     {
-        TH1 *ped_hist = channel->GetHist("Pedestal");
+        std::string name = "pedfit_" + std::to_string(i);
+        fits.push_back(new TF1(name.c_str(), "gaus", 0, 8191));
+    }
 
-        if(ped_hist == nullptr || ped_hist->Integral() < 1000)
-            continue;
+    driver.Run(adc_list.size(),
+               [&] (size_t i, unsigned int worker, std::ostream &os)
+               {
+                   PRadADCChannel *channel = adc_list[i];
+                   const PRadPedestalEstimator &ped_est = channel->GetPedestalEstimator();
+                   if(!ped_fit_check || ped_est.GetEntries() < 1000)
+                       return;
+
+                   TH1 *ped_hist = channel->GetHist("Pedestal");
+                   if(!ped_hist || ped_hist->Integral() < 1000)
+                       return;
+
+                   ped_hist->Fit(fits[worker], "qww");
+
+                   TF1 *myfit = ped_hist->GetFunction(fits[worker]->GetName());
+                   double f0 = myfit->GetParameter(1);
+                   double f1 = myfit->GetParameter(2);
+                   if(!ped_est.IsConsistent(f0, f1)) {
+                       os << "PRad HyCal System Warning: Pedestal of "
+                          << channel->GetName() << " is estimated as ("
+                          << ped_est.GetMean() << ", " << ped_est.GetSigma()
+                          << "), but the fit gives ("
+                          << f0 << ", " << f1 << ")."
+                          << std::endl;
+                   }
+               });
+    driver.Flush();
+
+    for(auto &fit : fits)
+        delete fit;
 
-        ped_hist->Fit("gaus", "qww");
+    for(auto &channel : adc_list)
+    {
+        const PRadPedestalEstimator &ped_est = channel->GetPedestalEstimator();
 
-        TF1 *myfit = (TF1*) ped_hist->GetFunction("gaus");
-        double p0 = myfit->GetParameter(1);
-        double p1 = myfit->GetParameter(2);
+        if(ped_est.GetEntries() < 1000)
+            continue;
 
-        channel->SetPedestal(p0, p1);
+        channel->SetPedestal(ped_est.GetMean(), ped_est.GetSigma());
     }
+
+    UpdateEnergyTable();
 }
 
 void PRadHyCalSystem::CorrectGainFactor(int ref)
@@ -1061,8 +1120,19 @@ void PRadHyCalSystem::CorrectGainFactor(int ref)
         return;
     }
 
+    // the channel fits are spread over workers, each worker has its own fit
+    PRadFitDriver driver;
+    std::vector<TF1*> fits;
+    for(unsigned int i = 0; i < driver.GetWorkers(); ++i)
+    {
+        std::string name = "tmpfit_" + std::to_string(i);
+        fits.push_back(new TF1(name.c_str(), "gaus", 0, 8191));
+    }
+
     // lamda expression, fit a gaussian and return the mean value
     auto fit_gaussian = [] (TH1* hist,
+                            TF1 *fit,
+                            std::ostream &os,
                             const int &range_min = 0,
                             const int &range_max = 8191,
                             const double &warn_ratio = 0.06)
@@ -1071,64 +1141,137 @@ void PRadHyCalSystem::CorrectGainFactor(int ref)
                             int end_bin = hist->GetXaxis()->FindBin(range_max) - 1;
 
                             if(hist->Integral(beg_bin, end_bin) < 1000) {
-                                std::cout << "PRad HyCal System Warning: "
-                                          << "Not enough entries in histogram "
-                                          << hist->GetName()
-                                          << ". Abort fitting!"
-                                          << std::endl;
+                                os << "PRad HyCal System Warning: "
+                                   << "Not enough entries in histogram "
+                                   << hist->GetName()
+                                   << ". Abort fitting!"
+                                   << std::endl;
                                 return 0.;
                             }
 
-                            TF1 *fit = new TF1("tmpfit", "gaus", range_min, range_max);
-
+                            fit->SetRange(range_min, range_max);
                             hist->Fit(fit, "qR");
-                            TF1 *hist_fit = hist->GetFunction("tmpfit");
+                            TF1 *hist_fit = hist->GetFunction(fit->GetName());
                             double mean = hist_fit->GetParameter(1);
                             double sigma = hist_fit->GetParameter(2);
                             if(sigma/mean > warn_ratio) {
-                                std::cout << "PRad HyCal System Warning: "
-                                          << "Bad fit for " << hist->GetTitle()
-                                          << ". Mean: " << mean
-                                          << ", sigma: " << sigma
-                                          << std::endl;
+                                os << "PRad HyCal System Warning: "
+                                   << "Bad fit for " << hist->GetTitle()
+                                   << ". Mean: " << mean
+                                   << ", sigma: " << sigma
+                                   << std::endl;
                             }
-                            delete fit;
                             return mean;
                         };
 
-    double ped_mean = fit_gaussian(ref_alpha, 0, PED_LED_REF, 0.02);
-    double alpha_mean = fit_gaussian(ref_alpha, PED_LED_REF + 1, 8191, 0.05);
-    double led_mean = fit_gaussian(ref_led);
+    double ped_mean = fit_gaussian(ref_alpha, fits[0], std::cout, 0, PED_LED_REF, 0.02);
+    double alpha_mean = fit_gaussian(ref_alpha, fits[0], std::cout, PED_LED_REF + 1, 8191, 0.05);
+    double led_mean = fit_gaussian(ref_led, fits[0], std::cout);
 
     if(ped_mean == 0. || alpha_mean == 0. || led_mean == 0.) {
         std::cerr << "PRad HyCal System Error: Failed to get gain factor from "
                   << reference << ", abort gain correction."
                   << std::endl;
+        for(auto &fit : fits)
+            delete fit;
         return;
     }
 
     double ref_factor = (led_mean - ped_mean)/(alpha_mean - ped_mean);
 
-    for(auto channel : adc_list)
+    // fit the led signals of all channels
+    std::vector<double> ch_led(adc_list.size(), 0.);
+    driver.Run(adc_list.size(),
+               [&] (size_t i, unsigned int worker, std::ostream &os)
+               {
+                   PRadADCChannel *channel = adc_list[i];
+                   if(!channel->GetModule())
+                       return;
+
+                   TH1 *hist = channel->GetHist("LMS");
+                   if(!hist)
+                       return;
+
+                   ch_led[i] = fit_gaussian(hist, fits[worker], os)
+                               - channel->GetPedestal().mean;
+
+                   if(ch_led[i] <= PED_LED_HYC) {
+                       os << "PRad HyCal System Error: Gain factor of "
+                          << channel->GetModule()->GetName()
+                          << " is not updated due to bad fit of LED signal."
+                          << std::endl;
+                   }
+               });
+    driver.Flush();
+
+    for(size_t i = 0; i < adc_list.size(); ++i)
     {
-        PRadHyCalModule *module = channel->GetModule();
-        if(!module)
-            continue;
+        PRadHyCalModule *module = adc_list[i]->GetModule();
+        // meaningful led signal
+        if(module && ch_led[i] > PED_LED_HYC)
+            module->GainCorrection(ch_led[i]/ref_factor, ref);
+    }
 
-        TH1 *hist = channel->GetHist("LMS");
-        if(!hist)
-            continue;
+    for(auto &fit : fits)
+        delete fit;
 
-        double ch_led = fit_gaussian(hist) - channel->GetPedestal().mean;
+    UpdateEnergyTable();
+}
 
-        if(ch_led > PED_LED_HYC) {// meaningful led signal
-            module->GainCorrection(ch_led/ref_factor, ref);
-        } else {
-            std::cout << "PRad HyCal System Error: Gain factor of "
-                      << module->GetName()
-                      << " is not updated due to bad fit of LED signal."
-                      << std::endl;
-        }
+// update the pedestal and gain tables for adc to energy conversion, it is
+// automatically called by the functions that change pedestals or calibration
+// constants in this system, the others should call it after the change
+void PRadHyCalSystem::UpdateEnergyTable()
+{
+    ch_ped.resize(adc_list.size());
+    ch_gain.resize(adc_list.size());
+
+    for(size_t i = 0; i < adc_list.size(); ++i)
+    {
+        PRadHyCalModule *module = adc_list[i]->GetModule();
+        ch_ped[i] = adc_list[i]->GetPedestal().mean;
+        ch_gain[i] = module ? module->GetCalibConst().GetCalibConst() : 0.;
     }
 }
 
+// sum of the energy from adc values, same as summing PRadADCChannel::GetEnergy
+// with the tables, it is written in a branchless way and accumulates in 4 lanes
+// so the compiler can vectorize it
+double PRadHyCalSystem::sumEnergy(const std::vector<ADC_Data> &adc_data)
+const
+{
+    const size_t nch = ch_gain.size();
+    if(!nch)
+        return 0.;
+
+    const double *ped = &ch_ped[0];
+    const double *gain = &ch_gain[0];
+    const ADC_Data *data = adc_data.data();
+    const size_t size = adc_data.size();
+
+    double esum[4] = {0., 0., 0., 0.};
+    size_t i = 0;
+    for(; i + 4 <= size; i += 4)
+    {
+        for(size_t j = 0; j < 4; ++j)
+        {
+            size_t id = data[i + j].channel_id;
+            bool valid = id < nch;
+            size_t idx = valid ? id : 0;
+            double val = (double)data[i + j].value - ped[idx];
+            esum[j] += (valid && val > 0.) ? val*gain[idx] : 0.;
+        }
+    }
+
+    for(; i < size; ++i)
+    {
+        size_t id = data[i].channel_id;
+        if(id >= nch)
+            continue;
+        double val = (double)data[i].value - ped[id];
+        if(val > 0.)
+            esum[0] += val*gain[id];
+    }
+
+    return (esum[0] + esum[1]) + (esum[2] + esum[3]);
+}
@@ -86,7 +86,11 @@ const
     // clear container first
     clusters.clear();
 
-    std::vector<std::vector<ModuleHit*>> groups;
+    // the groups are kept for the thread, their buffers are reused
+    static thread_local std::vector<std::vector<ModuleHit*>> groups;
+    for(auto &group : groups)
+        PRadVectorPool<ModuleHit*>::Release(group);
+    groups.clear();
 
     // group adjacent hits
     groupHits(hits, groups);
@@ -108,12 +112,12 @@ const
     // roughly combine all adjacent hits
     for(auto &hit : hits)
     {
-        if(hit.energy < min_module_energy.at(hit.geo.type))
+        if(hit.energy < min_module_energy.at(hit.GetType()))
             continue;
 
         // not belong to any existing cluster
         if(!fillClusters(hit, groups)) {
-            std::vector<ModuleHit*> new_group;
+            std::vector<ModuleHit*> new_group = PRadVectorPool<ModuleHit*>::Acquire();
             new_group.reserve(50);
             new_group.push_back(&hit);
             groups.emplace_back(std::move(new_group));
@@ -129,6 +133,7 @@ const
         {
             if(checkAdjacent(*it, *it_next)) {
                 it_next->insert(it_next->end(), it->begin(), it->end());
+                PRadVectorPool<ModuleHit*>::Release(*it);
                 groups.erase(it--);
                 break;
             }
@@ -172,19 +177,64 @@ const
     return false;
 }
 
-// some global container and function to help splitting and improve performance
+// some containers and functions to help splitting and improve performance,
+// every thread has its own containers so the events can be clustered in parallel
 #define SPLIT_MAX_HITS 100
 #define SPLIT_MAX_CLUSTERS 10
-float __ic_frac[SPLIT_MAX_HITS][SPLIT_MAX_CLUSTERS];
-float __ic_tot_frac[SPLIT_MAX_HITS];
+// fractions are stored maximum by maximum, so the loops over hits read
+// contiguous memory and can be vectorized by the compiler
+static thread_local float __ic_frac[SPLIT_MAX_CLUSTERS][SPLIT_MAX_HITS];
+static thread_local float __ic_tot_frac[SPLIT_MAX_HITS];
+// hits information in structure of arrays
+static thread_local double __ic_x[SPLIT_MAX_HITS];      // module x
+static thread_local double __ic_y[SPLIT_MAX_HITS];      // module y
+static thread_local float __ic_E[SPLIT_MAX_HITS];       // module energy
+static thread_local double __ic_sx[SPLIT_MAX_HITS];     // module size x
+static thread_local double __ic_sy[SPLIT_MAX_HITS];     // module size y
+static thread_local int __ic_type[SPLIT_MAX_HITS];      // module type
+static thread_local int __ic_dx[SPLIT_MAX_HITS];        // quantized x distance to the center
+static thread_local int __ic_dy[SPLIT_MAX_HITS];        // quantized y distance to the center
+// indices of the hits that are within 3x3 of the maximums
+static thread_local int __ic_adj[SPLIT_MAX_CLUSTERS][SPLIT_MAX_HITS];
+static thread_local int __ic_nadj[SPLIT_MAX_CLUSTERS];
 
 inline void __ic_sum_frac(size_t hits, size_t maximums)
 {
-    for(size_t i = 0; i < hits; ++i)
+    for(size_t j = 0; j < hits; ++j)
+        __ic_tot_frac[j] = 0;
+
+    for(size_t i = 0; i < maximums; ++i)
+    {
+        const float *frac = __ic_frac[i];
+        for(size_t j = 0; j < hits; ++j)
+            __ic_tot_frac[j] += frac[j];
+    }
+}
+
+// fill the hits into the arrays
+inline void __ic_fill_hits(const std::vector<ModuleHit*> &hits)
+{
+    for(size_t j = 0; j < hits.size(); ++j)
+    {
+        const auto &geo = hits[j]->GetGeometry();
+        __ic_x[j] = geo.x;
+        __ic_y[j] = geo.y;
+        __ic_E[j] = hits[j]->energy;
+        __ic_sx[j] = geo.size_x;
+        __ic_sy[j] = geo.size_y;
+        __ic_type[j] = geo.type;
+    }
+}
+
+// quantize the distances between the hits and a point
+// it uses the same quantization as PRadClusterProfile::GetProfile(x, y, hit)
+// for the hits belong to the same part with the point, no branch so it vectorizes
+inline void __ic_quantize(const float &x, const float &y, size_t hits)
+{
+    for(size_t j = 0; j < hits; ++j)
     {
-        __ic_tot_frac[i] = 0;
-        for(size_t j = 0; j < maximums; ++j)
-            __ic_tot_frac[i] += __ic_frac[i][j];
+        __ic_dx[j] = PRadClusterProfile::quantize(x - __ic_x[j], __ic_sx[j]);
+        __ic_dy[j] = PRadClusterProfile::quantize(y - __ic_y[j], __ic_sy[j]);
     }
 }
 
@@ -194,7 +244,8 @@ void PRadIslandCluster::splitCluster(const std::vector<ModuleHit*> &group,
 const
 {
     // find local maximum
-    auto maximums = findMaximums(group);
+    static thread_local std::vector<ModuleHit*> maximums;
+    findMaximums(group, maximums);
 
     // no cluster center found
     if(maximums.empty())
@@ -216,11 +267,11 @@ const
 }
 
 // find local maximums in a group of adjacent hits
-std::vector<ModuleHit*> PRadIslandCluster::findMaximums(const std::vector<ModuleHit*> &hits)
+void PRadIslandCluster::findMaximums(const std::vector<ModuleHit*> &hits,
+                                     std::vector<ModuleHit*> &local_max)
 const
 {
-    std::vector<ModuleHit*> local_max;
-    local_max.reserve(20);
+    local_max.clear();
     for(auto it = hits.begin(); it != hits.end(); ++it)
     {
         auto &hit1 = *it;
@@ -245,8 +296,6 @@ const
             local_max.push_back(hit1);
         }
     }
-
-    return local_max;
 }
 
 // split hits between several local maximums inside a cluster group
@@ -255,19 +304,27 @@ void PRadIslandCluster::splitHits(const std::vector<ModuleHit*> &maximums,
                                   std::vector<ModuleCluster> &clusters)
 const
 {
-    // initialize fractions
+    // copy the hits to contiguous arrays
+    __ic_fill_hits(hits);
+
+    // initialize fractions and find the 3x3 hits around maximums
     for(size_t i = 0; i < maximums.size(); ++i)
     {
         auto &center = *maximums.at(i);
+        __ic_nadj[i] = 0;
         for(size_t j = 0; j < hits.size(); ++j)
         {
             auto &hit = *hits.at(j);
-            __ic_frac[j][i] = __ic_prof.GetProfile(center, hit).frac*center.energy;
+            __ic_frac[i][j] = __ic_prof.GetProfile(center, hit).frac*center.energy;
+
+            // using 3x3 to reconstruct hit position
+            if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT)
+                __ic_adj[i][__ic_nadj[i]++] = j;
         }
     }
 
     // do iteration to evaluate the share of hits between several maximums
-    evalFraction(hits, maximums, split_iter);
+    evalFraction(maximums, hits, split_iter);
 
     // done iteration, add cluster according to the final share of energy
     for(size_t i = 0; i < maximums.size(); ++i)
@@ -277,17 +334,17 @@ const
 
         for(size_t j = 0; j < hits.size(); ++j)
         {
-            if(__ic_frac[j][i] == 0.)
+            if(__ic_frac[i][j] == 0.)
                 continue;
 
             // too small share, treat as zero
-            if(__ic_frac[j][i]/__ic_tot_frac[j] < least_share) {
-                __ic_tot_frac[j] -= __ic_frac[j][i];
+            if(__ic_frac[i][j]/__ic_tot_frac[j] < least_share) {
+                __ic_tot_frac[j] -= __ic_frac[i][j];
                 continue;
             }
 
             ModuleHit new_hit(*hits.at(j));
-            new_hit.energy *= __ic_frac[j][i]/__ic_tot_frac[j];
+            new_hit.energy *= __ic_frac[i][j]/__ic_tot_frac[j];
             cluster.AddHit(new_hit);
 
             // update the center energy
@@ -297,52 +354,61 @@ const
     }
 }
 
-inline void PRadIslandCluster::evalFraction(const std::vector<ModuleHit*> &hits,
-                                            const std::vector<ModuleHit*> &maximums,
+// the hits information should be already filled in the global arrays
+inline void PRadIslandCluster::evalFraction(const std::vector<ModuleHit*> &maximums,
+                                            const std::vector<ModuleHit*> &hits,
                                             size_t iters)
 const
 {
     // temp containers for reconstruction
     BaseHit temp[POS_RECON_HITS];
+    size_t nhits = hits.size();
 
     // iterations to refine the split energies
     while(iters-- > 0)
     {
-        __ic_sum_frac(hits.size(), maximums.size());
+        __ic_sum_frac(nhits, maximums.size());
         for(size_t i = 0; i < maximums.size(); ++i)
         {
-            // cluster center reconstruction
-            auto &center = *maximums.at(i);
+            float *frac = __ic_frac[i];
+
+            // cluster center reconstruction, only 3x3 hits participate
             float tot_E = 0.;
             int count = 0;
-            for(size_t j = 0; j < hits.size(); ++j)
+            for(int k = 0; k < __ic_nadj[i] && count < POS_RECON_HITS; ++k)
             {
-                auto &hit = *hits.at(j);
-                if(__ic_frac[j][i] == 0.)
+                int j = __ic_adj[i][k];
+                if(frac[j] == 0.)
                     continue;
 
-                // using 3x3 to reconstruct hit position
-                if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-                    temp[count].x = hit.geo.x;
-                    temp[count].y = hit.geo.y;
-                    temp[count].E = hit.energy*__ic_frac[j][i]/__ic_tot_frac[j];
-                    tot_E += temp[count].E;
-                    count++;
-                }
+                temp[count].x = __ic_x[j];
+                temp[count].y = __ic_y[j];
+                temp[count].E = __ic_E[j]*frac[j]/__ic_tot_frac[j];
+                tot_E += temp[count].E;
+                count++;
             }
 
             BaseHit recon;
             PRadHyCalCluster::reconstructPos(temp, count, &recon);
 
             // update profile with the reconstructed center
-            for(size_t j = 0; j < hits.size(); ++j)
+            // the profile type is determined by the sector of the center
+            int sect = PRadClusterProfile::get_sector(recon.x, recon.y);
+            int type = (sect == 0) ? PRadHyCalModule::PbWO4 : PRadHyCalModule::PbGlass;
+            __ic_quantize(recon.x, recon.y, nhits);
+
+            // gathered lookup for all hits as if they are in the same part
+            __ic_prof.GetFractions(type, __ic_dx, __ic_dy, nhits, tot_E, frac);
+
+            // hits in the other part need the boundary crossing treatment
+            for(size_t j = 0; j < nhits; ++j)
             {
-                auto &hit = *hits.at(j);
-                __ic_frac[j][i] = __ic_prof.GetProfile(recon.x, recon.y, hit).frac*tot_E;
+                if(__ic_type[j] != type)
+                    frac[j] = __ic_prof.GetProfile(recon.x, recon.y, *hits.at(j)).frac*tot_E;
             }
         }
     }
-    __ic_sum_frac(hits.size(), maximums.size());
+    __ic_sum_frac(nhits, maximums.size());
 }
 
 
@@ -378,7 +444,7 @@ const
     for(auto &hit : hits)
     {
         // less than min module energy, ignore this hit
-        if(hit.energy < min_module_energy.at(hit.geo.type))
+        if(hit.energy < min_module_energy.at(hit.GetType()))
             continue;
 
         // not belongs to any cluster, and the energy is larger than center threshold
@@ -393,8 +459,8 @@ const
 bool PRadIslandCluster::fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &c)
 const
 {
-    std::vector<unsigned int> indices;
-    indices.reserve(5);
+    static thread_local std::vector<unsigned int> indices;
+    indices.clear();
 
     for(unsigned int i = 0; i < c.size(); ++i)
     {
@@ -0,0 +1,180 @@
+//============================================================================//
+// A streaming estimator for pedestal mean and sigma                          //
+// It replaces the Gaussian fit on pedestal histograms. The first values are  //
+// used to get a robust starting point (median and MAD), then the mean and    //
+// variance are updated on the fly, values that are too far away from the    //
+// current mean are rejected (signals, pile-up, bad words)                    //
+//============================================================================//
+
+#include "PRadPedestalEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+
+
+//============================================================================//
+// Constructor                                                                //
+//============================================================================//
+
+PRadPedestalEstimator::PRadPedestalEstimator(double c, double s)
+: clip(c), min_sigma(s)
+{
+    Reset();
+}
+
+
+
+//============================================================================//
+// Public Member Functions                                                    //
+//============================================================================//
+
+// fill a value
+void PRadPedestalEstimator::Fill(const double &val)
+{
+#ifndef NDEBUG
+    bool busy = filling.busy.exchange(true, std::memory_order_acquire);
+    assert(!busy && "PRadPedestalEstimator is filled by several threads");
+    (void) busy;
+#endif
+
+    fill(val);
+
+#ifndef NDEBUG
+    filling.busy.store(false, std::memory_order_release);
+#endif
+}
+
+// reset the estimator
+void PRadPedestalEstimator::Reset()
+{
+    seeds.clear();
+    seeds.reserve(PED_EST_SEED_SIZE);
+    seeded = false;
+    count = 0;
+    rejected = 0;
+    mean = 0.;
+    m2 = 0.;
+}
+
+// number of accepted values
+unsigned int PRadPedestalEstimator::GetEntries()
+const
+{
+    if(!seeded)
+        return seeds.size();
+
+    return count;
+}
+
+// get the mean, it is only an estimation from the seeds if there are not
+// enough values
+double PRadPedestalEstimator::GetMean()
+const
+{
+    if(!seeded) {
+        PRadPedestalEstimator est(*this);
+        est.seed();
+        return est.mean;
+    }
+
+    return mean;
+}
+
+// get the sigma, it is only an estimation from the seeds if there are not
+// enough values
+double PRadPedestalEstimator::GetSigma()
+const
+{
+    if(!seeded) {
+        PRadPedestalEstimator est(*this);
+        est.seed();
+        return est.GetSigma();
+    }
+
+    if(count < 2)
+        return 0.;
+
+    return std::sqrt(m2/(count - 1));
+}
+
+
+// check if the estimation agrees with the other mean and sigma (from a fit),
+// mean should be within mean_tol*sigma and sigma within sigma_tol*sigma
+bool PRadPedestalEstimator::IsConsistent(const double &m, const double &s,
+                                         double mean_tol, double sigma_tol)
+const
+{
+    double ref = std::max(s, min_sigma);
+    return (std::abs(GetMean() - m) <= mean_tol*ref) &&
+           (std::abs(GetSigma() - s) <= sigma_tol*ref);
+}
+
+
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// fill a value, the first values are buffered as seeds
+void PRadPedestalEstimator::fill(const double &val)
+{
+    if(seeded) {
+        if(accept(val))
+            update(val);
+        else
+            ++rejected;
+        return;
+    }
+
+    seeds.push_back(val);
+    if(seeds.size() >= PED_EST_SEED_SIZE)
+        seed();
+}
+
+// get the starting point from the buffered values
+void PRadPedestalEstimator::seed()
+{
+    seeded = true;
+
+    if(seeds.empty())
+        return;
+
+    std::vector<float> sorted(seeds);
+    size_t half = sorted.size()/2;
+    std::nth_element(sorted.begin(), sorted.begin() + half, sorted.end());
+    double median = sorted[half];
+
+    for(auto &val : sorted)
+        val = std::abs(val - median);
+    std::nth_element(sorted.begin(), sorted.begin() + half, sorted.end());
+    // MAD to sigma for a Gaussian distribution
+    double sigma = std::max(1.4826*sorted[half], min_sigma);
+
+    for(auto &val : seeds)
+    {
+        if(std::abs(val - median) <= clip*sigma)
+            update(val);
+        else
+            ++rejected;
+    }
+
+    seeds.clear();
+    seeds.shrink_to_fit();
+}
+
+// Welford's algorithm
+inline void PRadPedestalEstimator::update(const double &val)
+{
+    ++count;
+    double delta = val - mean;
+    mean += delta/count;
+    m2 += delta*(val - mean);
+}
+
+inline bool PRadPedestalEstimator::accept(const double &val)
+const
+{
+    double sigma = (count > 1) ? std::sqrt(m2/(count - 1)) : 0.;
+    return std::abs(val - mean) <= clip*std::max(sigma, min_sigma);
+}
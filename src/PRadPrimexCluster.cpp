@@ -6,12 +6,29 @@
 //============================================================================//
 
 #include "PRadPrimexCluster.h"
+#include <cstring>
+#include <algorithm>
+#ifdef USE_PRIMEX_METHOD
+#include <mutex>
+#endif
 
 
-// a temporary storage to convert row and col back to id
-// which is needed in fetching result from island.F
-int __prcl_ich[MROW][MCOL];
-#define ICH(M,N) __prcl_ich[N-1][M-1]
+// sector settings for island, and the column/row offsets to convert the module
+// id to column and row in the sector
+struct __prcl_sector
+{
+    PRadPrimexIsland::Sector sect;
+    int col_offset, row_offset;
+};
+
+static const __prcl_sector __prcl_sectors[MSECT] =
+{
+    {PRadPrimexIsland::Sector(0, 34, 34, CRYS_SIZE_X, CRYS_SIZE_Y),  0,  0},
+    {PRadPrimexIsland::Sector(1, 24,  6, GLASS_SIZE, GLASS_SIZE),    0,  0},
+    {PRadPrimexIsland::Sector(2,  6, 24, GLASS_SIZE, GLASS_SIZE),   24,  0},
+    {PRadPrimexIsland::Sector(3, 24,  6, GLASS_SIZE, GLASS_SIZE),    6, 24},
+    {PRadPrimexIsland::Sector(4,  6, 24, GLASS_SIZE, GLASS_SIZE),    0,  6},
+};
 
 PRadPrimexCluster::PRadPrimexCluster(const std::string &path)
 {
@@ -58,12 +75,24 @@ void PRadPrimexCluster::Configure(const std::string &path)
             min_module_energy[i] = value.Float();
     }
 
+    // run the fortran code on the same sectors and compare the results
+    validate = getDefConfig<bool>("Primex Fortran Validation", false, verbose);
+
+#ifdef USE_PRIMEX_METHOD
     // pass parameters to fortran code
     // MeV to GeV
     SET_EMIN  = min_cluster_energy*0.001;   // banks->CONFIG->config->CLUSTER_ENERGY_MIN;
     SET_EMAX  = 9.9;                        // banks->CONFIG->config->CLUSTER_ENERGY_MAX;
     SET_HMIN  = min_cluster_size;           // banks->CONFIG->config->CLUSTER_MIN_HITS_NUMBER;
     SET_MINM  = min_center_energy*0.001;    // banks->CONFIG->config->CLUSTER_MAX_CELL_MIN_ENERGY;
+#else
+    if(validate) {
+        std::cout << "PRad HyCal Cluster Warning: Fortran island code is not "
+                  << "compiled (USE_PRIMEX_METHOD), validation is disabled."
+                  << std::endl;
+        validate = false;
+    }
+#endif
 }
 
 void PRadPrimexCluster::LoadCrystalProfile(const std::string &path)
@@ -71,9 +100,13 @@ void PRadPrimexCluster::LoadCrystalProfile(const std::string &path)
     if(path.empty())
         return;
 
-    char c_path[path.size()];
+    island.LoadProfile(0, path);
+
+#ifdef USE_PRIMEX_METHOD
+    char c_path[path.size() + 1];
     strcpy(c_path, path.c_str());
     load_pwo_prof_(c_path, strlen(c_path));
+#endif
 }
 
 void PRadPrimexCluster::LoadLeadGlassProfile(const std::string &path)
@@ -81,9 +114,13 @@ void PRadPrimexCluster::LoadLeadGlassProfile(const std::string &path)
     if(path.empty())
         return;
 
-    char c_path[path.size()];
+    island.LoadProfile(1, path);
+
+#ifdef USE_PRIMEX_METHOD
+    char c_path[path.size() + 1];
     strcpy(c_path, path.c_str());
     load_lg_prof_(c_path, strlen(c_path));
+#endif
 }
 
 void PRadPrimexCluster::UpdateModuleStatus(const std::vector<PRadHyCalModule*> &mlist)
@@ -115,21 +152,32 @@ const
     // clear container first
     clusters.clear();
 
-    // build a hit map
-    std::map<int, ModuleHit*> hit_map;
-    for(auto &hit : hits)
-    {
-        hit_map[hit.id] = &hit;
-    }
+    // working arrays of island, reused by the events in the same thread
+    static thread_local PRadPrimexIsland::Workspace workspace;
+    static thread_local std::vector<PRadPrimexIsland::Gamma> gammas;
+
+    // distribute the hits to the sectors in one pass
+    SectorHits sect_hits[MSECT];
+    fillSectors(hits, sect_hits);
 
-    // call island reconstruction of each sectors
+    // island reconstruction of each sectors
     // HyCal has 5 sectors, 4 for lead glass one for crystal
-    std::vector<std::vector<ModuleCluster>> sect_clusters;
-    sect_clusters.resize(MSECT);
+    static thread_local std::vector<ModuleCluster> sect_clusters[MSECT];
     for(int isect = 0; isect < MSECT; ++isect)
     {
-        callIsland(hits, isect);
-        sect_clusters[isect] = getIslandResult(hit_map);
+        sect_clusters[isect].clear();
+
+        // nothing can be found in a sector without hits
+        if(!sect_hits[isect].count)
+            continue;
+
+        island.Reconstruct(__prcl_sectors[isect].sect, sect_hits[isect].ech,
+                           module_status[isect], gammas, workspace);
+#ifdef USE_PRIMEX_METHOD
+        if(validate)
+            validateIsland(isect, sect_hits[isect], gammas);
+#endif
+        getIslandResult(gammas, sect_hits[isect], sect_clusters[isect]);
     }
 
     // glue clusters separated by the sector
@@ -137,7 +185,7 @@ const
     {
         for(int j = i + 1; j < MSECT; ++j)
         {
-            glueClusters(sect_clusters.at(i), sect_clusters.at(j));
+            glueClusters(sect_clusters[i], sect_clusters[j]);
         }
     }
 
@@ -151,117 +199,82 @@ const
     }
 }
 
-void PRadPrimexCluster::callIsland(const std::vector<ModuleHit> &hits, int isect)
+// convert the hits to the column and row in their sectors
+void PRadPrimexCluster::fillSectors(std::vector<ModuleHit> &hits, SectorHits *sect_hits)
 const
 {
-    // determine sector's column and row ranges
-    ISECT = isect;
-    int coloffset = 0, rowoffset = 0;
-    switch(isect)
-    {
-    case 0:
-        NCOL = 34; NROW = 34;
-        SET_XSIZE = CRYS_SIZE_X; SET_YSIZE = CRYS_SIZE_Y;
-        break;
-    case 1:
-        NCOL = 24; NROW =  6;
-        SET_XSIZE = GLASS_SIZE; SET_YSIZE = GLASS_SIZE;
-        coloffset = 0, rowoffset = 0;
-        break;
-    case 2:
-        NCOL =  6; NROW =  24;
-        SET_XSIZE = GLASS_SIZE; SET_YSIZE = GLASS_SIZE;
-        coloffset = 24, rowoffset = 0;
-        break;
-    case 3:
-        NCOL = 24; NROW =  6;
-        SET_XSIZE = GLASS_SIZE; SET_YSIZE = GLASS_SIZE;
-        coloffset =  6, rowoffset = 24;
-        break;
-    case 4:
-        NCOL =  6; NROW = 24;
-        SET_XSIZE = GLASS_SIZE; SET_YSIZE = GLASS_SIZE;
-        coloffset = 0, rowoffset = 6;
-        break;
-    default:
-        printf("call_island bad sector given : %i\n",isect);
-        exit(1);
-    }
-
-    // load module status and reset energies
-    for(int icol = 1; icol <= NCOL; ++icol)
+    for(int isect = 0; isect < MSECT; ++isect)
     {
-        for(int irow = 1; irow <= NROW; ++irow)
-        {
-            ECH(icol,irow) = 0;
-            ICH(icol,irow) = -1;
-            STAT_CH(icol,irow) = module_status[isect][icol-1][irow-1];
-        }
+        SectorHits &sect = sect_hits[isect];
+        sect.count = 0;
+        memset(sect.ech, 0, sizeof(sect.ech));
+        std::fill(&sect.hits[0][0], &sect.hits[0][0] + MCOL*MROW, nullptr);
     }
 
-    // load hits in this sector
     for(auto &hit : hits)
     {
-        // not belong to this sector or energy is too low
-        if((hit.sector != isect) ||
-           (hit.energy < min_module_energy.at(hit.geo.type)))
+        // not belong to any sector or energy is too low
+        if((hit.sector < 0) || (hit.sector >= MSECT) ||
+           (hit.energy < min_module_energy.at(hit.GetType())))
             continue;
 
+        const __prcl_sector &sect = __prcl_sectors[hit.sector];
+        const int &ncol = sect.sect.ncol, &nrow = sect.sect.nrow;
         const int &id  = hit.id;
         int column, row;
         if(id > 1000) {
-            column = (id-1001)%NCOL+1;
-            row    = (id-1001)/NROW+1;
+            column = (id-1001)%ncol+1;
+            row    = (id-1001)/nrow+1;
         } else {
-            column = (id-1)%(NCOL+NROW)+1-coloffset;
-            row    = (id-1)/(NCOL+NROW)+1-rowoffset;
+            column = (id-1)%(ncol+nrow)+1-sect.col_offset;
+            row    = (id-1)/(ncol+nrow)+1-sect.row_offset;
         }
 
+        if(column < 1 || column > ncol || row < 1 || row > nrow)
+            continue;
+
         // discretize to 0.1 MeV
-        ECH(column,row) = int(hit.energy*10. + 0.5);
-        ICH(column,row) = id;
+        SectorHits &sh = sect_hits[hit.sector];
+        sh.ech[column-1][row-1] = int(hit.energy*10. + 0.5);
+        sh.hits[column-1][row-1] = &hit;
+        sh.count++;
     }
-
-    // call fortran code to reconstruct clusters
-    main_island_();
 }
 
-// get result from fortran island code
-std::vector<ModuleCluster> PRadPrimexCluster::getIslandResult(const std::map<int, ModuleHit*> &hmap)
+// get result from island
+void PRadPrimexCluster::getIslandResult(const std::vector<PRadPrimexIsland::Gamma> &gammas,
+                                        const SectorHits &sect_hits,
+                                        std::vector<ModuleCluster> &res)
 const
 {
-    std::vector<ModuleCluster> res;
-    res.reserve(10);
+    res.clear();
+    res.reserve(gammas.size());
 
-    for(int k = 0; k < adcgam_cbk_.nadcgam; ++k)
+    for(auto &gam : gammas)
     {
-        int dime = adcgam_cbk_.u.iadcgam[k][8];
         ModuleCluster cluster;
         // GeV to MeV
-        cluster.energy = adcgam_cbk_.u.fadcgam[k][0]*1000.;
+        cluster.energy = gam.energy*1000.;
         cluster.leakage = cluster.energy;
 
-        for(int j = 0; j < (dime>MAX_CC ? MAX_CC : dime); ++j)
+        for(int j = 0; j < gam.nhits; ++j)
         {
-            int add = ICL_INDEX(k,j);
+            int add = gam.index[j];
             int kx = (add/100), ky = add%100;
-            int id = ICH(kx, ky);
             // convert back from 0.1 MeV
-            float ecell = 0.1*(float)ICL_IENER(k,j);
+            float ecell = 0.1*(float)gam.iener[j];
             cluster.leakage -= ecell;
-            auto it = hmap.find(id);
-            if(it != hmap.end())
+            const ModuleHit *module = sect_hits.hits[kx-1][ky-1];
+            if(module)
             {
-                ModuleHit hit(*it->second);
+                ModuleHit hit(*module);
                 hit.energy = ecell;
                 cluster.hits.push_back(hit);
             }
         }
         cluster.FindCenter();
-        res.push_back(cluster);
+        res.emplace_back(std::move(cluster));
     }
-
-    return res;
 }
 
 void PRadPrimexCluster::glueClusters(std::vector<ModuleCluster> &base,
@@ -310,3 +323,82 @@ const
     // TODO island.F has corrected the leakage
     // here we probably can add some inforamtion about the leakage correction
 }
+
+#ifdef USE_PRIMEX_METHOD
+// run the fortran code on the same sector and compare the results with the c++
+// port, return true if they are the same
+bool PRadPrimexCluster::validateIsland(int isect,
+                                       const SectorHits &sect_hits,
+                                       const std::vector<PRadPrimexIsland::Gamma> &gammas)
+const
+{
+    // the fortran code works on global variables
+    static std::mutex locker;
+    std::lock_guard<std::mutex> lock(locker);
+
+    const PRadPrimexIsland::Sector &sect = __prcl_sectors[isect].sect;
+    ISECT = sect.isect;
+    NCOL = sect.ncol;
+    NROW = sect.nrow;
+    SET_XSIZE = sect.xsize;
+    SET_YSIZE = sect.ysize;
+
+    for(int icol = 1; icol <= NCOL; ++icol)
+    {
+        for(int irow = 1; irow <= NROW; ++irow)
+        {
+            ECH(icol,irow) = sect_hits.ech[icol-1][irow-1];
+            STAT_CH(icol,irow) = module_status[isect][icol-1][irow-1];
+        }
+    }
+
+    main_island_();
+
+    bool same = (adcgam_cbk_.nadcgam == (int)gammas.size());
+    for(int k = 0; same && k < adcgam_cbk_.nadcgam; ++k)
+    {
+        const PRadPrimexIsland::Gamma &gam = gammas[k];
+        same = (adcgam_cbk_.u.iadcgam[k][7] == gam.type) &&
+               (adcgam_cbk_.u.iadcgam[k][8] == gam.dime) &&
+               (adcgam_cbk_.u.iadcgam[k][10] == gam.status) &&
+               (adcgam_cbk_.u.fadcgam[k][0] == gam.energy) &&
+               (adcgam_cbk_.u.fadcgam[k][1] == gam.x) &&
+               (adcgam_cbk_.u.fadcgam[k][2] == gam.y) &&
+               (adcgam_cbk_.u.fadcgam[k][6] == gam.chi2);
+
+        for(int j = 0; same && j < gam.nhits; ++j)
+        {
+            same = (ICL_INDEX(k,j) == gam.index[j]) &&
+                   (ICL_IENER(k,j) == gam.iener[j]);
+        }
+    }
+
+    if(!same) {
+        std::cout << "PRad HyCal Cluster Warning: Island results are different "
+                  << "in sector " << isect << ", fortran has "
+                  << adcgam_cbk_.nadcgam << " gammas and c++ has "
+                  << gammas.size() << " gammas."
+                  << std::endl;
+        for(int k = 0; k < adcgam_cbk_.nadcgam; ++k)
+        {
+            std::cout << "    fortran: " << adcgam_cbk_.u.fadcgam[k][0] << ", "
+                      << adcgam_cbk_.u.fadcgam[k][1] << ", "
+                      << adcgam_cbk_.u.fadcgam[k][2] << ", "
+                      << adcgam_cbk_.u.fadcgam[k][6] << ", "
+                      << adcgam_cbk_.u.iadcgam[k][7] << ", "
+                      << adcgam_cbk_.u.iadcgam[k][8] << ", "
+                      << adcgam_cbk_.u.iadcgam[k][10]
+                      << std::endl;
+        }
+        for(auto &gam : gammas)
+        {
+            std::cout << "    c++    : " << gam.energy << ", "
+                      << gam.x << ", " << gam.y << ", " << gam.chi2 << ", "
+                      << gam.type << ", " << gam.dime << ", " << gam.status
+                      << std::endl;
+        }
+    }
+
+    return same;
+}
+#endif
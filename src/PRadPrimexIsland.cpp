@@ -0,0 +1,934 @@
+//============================================================================//
+// C++ port of the PrimEx island algorithm in fortran/island.F                //
+// The structure and the names follow the fortran subroutines, so the two     //
+// can be compared line by line                                               //
+//   main_island -> Reconstruct, clus_hyc -> clusterHits,                     //
+//   gams_hyc -> gamsCluster, gamma_hyc -> gammaFit, out_hyc -> output        //
+// All the arrays are 0-indexed here                                          //
+//============================================================================//
+
+#include "PRadPrimexIsland.h"
+#include "ConfigParser.h"
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+// parameters from gams_hyc
+#define ISLAND_CHISQ1 90.f      // chi2 for preliminary gammas separation
+#define ISLAND_CHISQ2 50.f      // chi2 for final gammas separation
+#define ISLAND_NITER 6          // iterations to separate peaks
+#define ISLAND_MAX_PEAKS 10
+#define ISLAND_MAX_CLUSTERS 200
+
+// fortran nint for real
+static inline int __pi_nint(float val)
+{
+    return (int)std::lround(val);
+}
+
+
+
+//============================================================================//
+// Constructor                                                                //
+//============================================================================//
+
+PRadPrimexIsland::PRadPrimexIsland()
+{
+    // place holder
+}
+
+
+
+//============================================================================//
+// Public Member Functions                                                    //
+//============================================================================//
+
+// load profile, type 0 for PbWO4 and 1 for PbGlass, the same as load_pwo_prof
+// and load_lg_prof in island.F
+void PRadPrimexIsland::LoadProfile(int type, const std::string &path)
+{
+    if(path.empty() || type < 0 || type > 1)
+        return;
+
+    ConfigParser parser;
+    if(!parser.OpenFile(path)) {
+        std::cerr << "PRad Primex Island Error: File"
+                  << " \"" << path << "\"  "
+                  << "cannot be opened."
+                  << std::endl;
+        return;
+    }
+
+    std::vector<float> *cell_table = new std::vector<float>(ISLAND_PROF_STEPS*ISLAND_PROF_STEPS, 0.);
+    std::vector<float> *d2c_table = new std::vector<float>(ISLAND_PROF_STEPS*ISLAND_PROF_STEPS, 0.);
+
+    int x, y;
+    float val, d2;
+    while(parser.ParseLine())
+    {
+        if(!parser.CheckElements(4))
+            continue;
+
+        parser >> x >> y >> val >> d2;
+        if(x < 0 || y < 0 || x >= ISLAND_PROF_STEPS || y >= ISLAND_PROF_STEPS)
+            continue;
+
+        // x and y are symmetric
+        (*cell_table)[x*ISLAND_PROF_STEPS + y] = val;
+        (*cell_table)[y*ISLAND_PROF_STEPS + x] = val;
+        (*d2c_table)[x*ISLAND_PROF_STEPS + y] = d2;
+        (*d2c_table)[y*ISLAND_PROF_STEPS + x] = d2;
+    }
+
+    acell[type].reset(cell_table);
+    ad2c[type].reset(d2c_table);
+}
+
+bool PRadPrimexIsland::HasProfile(int type)
+const
+{
+    return (type >= 0) && (type <= 1) && acell[type];
+}
+
+// reconstruct gammas from one sector, main_island in island.F
+void PRadPrimexIsland::Reconstruct(const Sector &sect,
+                                   const Matrix &ech,
+                                   const Matrix &stat,
+                                   std::vector<Gamma> &gammas,
+                                   Workspace &ws)
+const
+{
+    gammas.clear();
+
+    // data_hyc, the addresses are in increasing order
+    ws.ia.clear();
+    ws.id.clear();
+    for(int i = 1; i <= sect.ncol; ++i)
+    {
+        for(int j = 1; j <= sect.nrow; ++j)
+        {
+            int ie = ech[i - 1][j - 1];
+            if(ie > 0) {
+                ws.ia.push_back(100*i + j);
+                ws.id.push_back(ie);
+            }
+        }
+    }
+
+    int nw = ws.ia.size();
+    if(nw > 0) {
+        clusterHits(ws, nw);
+
+        int ipncl = 0;
+        for(auto &leng : ws.lencl)
+        {
+            gamsCluster(sect, stat, leng, &ws.ia[ipncl], &ws.id[ipncl], gammas, ws);
+            ipncl += leng;
+        }
+    }
+
+    output(sect, gammas);
+}
+
+
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// the addresses must be in increasing order, order_hyc in island.F
+static void __pi_order(int nw, int *ia, int *id)
+{
+    for(int k = 1; k < nw; ++k)
+    {
+        if(ia[k] > ia[k - 1])
+            continue;
+
+        int iat = ia[k], idt = id[k];
+        int i = k - 1;
+        for(; i >= 0 && iat < ia[i]; --i)
+        {
+            ia[i + 1] = ia[i];
+            id[i + 1] = id[i];
+        }
+        ia[i + 1] = iat;
+        id[i + 1] = idt;
+    }
+}
+
+// clusters search, clus_hyc in island.F
+// the hits are reordered so each cluster is contiguous, the lengths are saved
+// in lencl
+void PRadPrimexIsland::clusterHits(Workspace &ws, int nw)
+const
+{
+    std::vector<int> &lencl = ws.lencl;
+    int *ia = ws.ia.data(), *id = ws.id.data();
+
+    lencl.clear();
+    if(nw < 2) {
+        lencl.push_back(nw);
+        return;
+    }
+
+    __pi_order(nw, ia, id);
+
+    lencl.reserve(ISLAND_MAX_CLUSTERS);
+    int next = 0;
+    for(int k = 1; k <= nw; ++k)
+    {
+        if(k < nw && ia[k] - ia[k - 1] <= 1)
+            continue;
+
+        int ib = next;                  // first word of the (sub)cluster
+        int ie = k - 1;                 // last word of the (sub)cluster
+        next = k;                       // first word of the next (sub)cluster
+        if((int)lencl.size() >= ISLAND_MAX_CLUSTERS)
+            return;
+        lencl.push_back(next - ib);
+
+        int ncl = lencl.size();
+        if(ncl == 1)
+            continue;
+
+        // glue the subclusters
+        int ias = ia[ib], iaf = ia[ie];
+        int last = ib - 1;
+        for(int icl = ncl - 2; icl >= 0; --icl)
+        {
+            int leng = lencl[icl];
+            // no subclusters to be glued
+            if(ias - ia[last] > 100)
+                break;
+
+            for(int i = last; i > last - leng; --i)
+            {
+                if(ias - ia[i] > 100)
+                    break;
+
+                // subclusters to be glued
+                if(iaf - ia[i] >= 100) {
+                    ncl = lencl.size();
+                    // move the subcluster right before the current one
+                    if(icl < ncl - 2) {
+                        std::rotate(ia + last + 1 - leng, ia + last + 1, ia + ib);
+                        std::rotate(id + last + 1 - leng, id + last + 1, id + ib);
+                    }
+                    ib -= leng;
+                    lencl[icl] = lencl.back() + leng;
+                    lencl.pop_back();
+                    if(icl < ncl - 2)
+                        std::rotate(lencl.begin() + icl, lencl.begin() + icl + 1, lencl.end());
+                    break;
+                }
+            }
+            last -= leng;
+        }
+    }
+}
+
+// process one cluster, gams_hyc in island.F
+void PRadPrimexIsland::gamsCluster(const Sector &sect, const Matrix &stat,
+                                   int nadc, int *ia, int *id,
+                                   std::vector<Gamma> &gammas,
+                                   Workspace &ws)
+const
+{
+    __pi_order(nadc, ia, id);
+
+    // peaks search
+    int idsum = 0;
+    for(int ic = 0; ic < nadc; ++ic)
+        idsum += id[ic];
+
+    int minpk = 1;
+    if(nadc >= 3) {
+        if(sect.isect != 0)
+            minpk = std::max(1, __pi_nint(20.f*std::log(1.f + 0.0001f*idsum)));
+        else
+            minpk = std::max(1, __pi_nint(7.f*std::log(1.f + 0.0001f*idsum)));
+    }
+    minpk *= 100;
+
+    int npk = 0;
+    int ipnpk[ISLAND_MAX_PEAKS];
+    for(int ic = 0; ic < nadc; ++ic)
+    {
+        int iac = id[ic];
+        if(iac < minpk)
+            continue;
+
+        int ixy = ia[ic];
+        int ixymax = ixy + 100 + 1;
+        int ixymin = ixy - 100 - 1;
+        int iyc = ixy - ixy/100*100;
+        bool peak = true;
+        for(int in = ic + 1; peak && in < nadc && ia[in] <= ixymax; ++in)
+        {
+            int iy = ia[in] - ia[in]/100*100;
+            if(std::abs(iy - iyc) <= 1 && id[in] >= iac)
+                peak = false;
+        }
+        for(int in = ic - 1; peak && in >= 0 && ia[in] >= ixymin; --in)
+        {
+            int iy = ia[in] - ia[in]/100*100;
+            if(std::abs(iy - iyc) <= 1 && id[in] > iac)
+                peak = false;
+        }
+        if(!peak)
+            continue;
+
+        ipnpk[npk++] = ic;
+        if(npk == ISLAND_MAX_PEAKS || npk >= 10000/nadc - 3)
+            break;
+    }
+
+    if(npk == 0)
+        return;
+
+    float chisq, e1, x1, y1;
+
+    // gamma search for one peak
+    if(npk == 1) {
+        if(gammas.size() >= MAX_GAMMAS - 1)
+            return;
+
+        int ic = ipnpk[0];
+        int ix = ia[ic]/100;
+        int iy = ia[ic] - ix*100;
+        int itype = peakType(sect, ix, iy);
+
+        chisq = ISLAND_CHISQ2;
+        gammaFit(sect, stat, nadc, ia, id, chisq, e1, x1, y1, ws);
+
+        gammas.emplace_back();
+        Gamma &gam = gammas.back();
+        gam.chi2 = chisq;
+        gam.type = itype;
+        gam.energy = e1;
+        gam.x = x1;
+        gam.y = y1;
+        gam.dime = nadc;
+        gam.id = 0;
+        gam.status = itype;
+        gam.nhits = std::min(nadc, MAX_CC);
+        for(int j = 0; j < gam.nhits; ++j)
+        {
+            gam.index[j] = ia[j];
+            gam.iener[j] = id[j];
+        }
+        return;
+    }
+
+    // gamma search for several peaks
+    if(gammas.size() >= MAX_GAMMAS - 1)
+        return;
+
+    // working arrays (nadc, 0:npk+2) in column major
+    int ncols = npk + 3;
+    ws.iwrk.assign(nadc*ncols, 0);
+    ws.fwrk.assign(nadc*ncols, 0.);
+    ws.idp.assign(nadc*ncols, 0);
+    int *iwrk = ws.iwrk.data(), *idp = ws.idp.data();
+    float *fwrk = ws.fwrk.data();
+    auto iw = [iwrk, nadc] (int i, int k) -> int& {return iwrk[k*nadc + i];};
+    auto fw = [fwrk, nadc] (int i, int k) -> float& {return fwrk[k*nadc + i];};
+    auto dp = [idp, nadc] (int i, int k) -> int& {return idp[k*nadc + i];};
+
+    // first step, preliminary estimation of (E, x, y) of the peaks
+    // start separation of peaks by an iterative procedure
+    float ratio = 1.;
+    float epk[ISLAND_MAX_PEAKS], xpk[ISLAND_MAX_PEAKS], ypk[ISLAND_MAX_PEAKS];
+    for(int iter = 1; iter <= ISLAND_NITER; ++iter)
+    {
+        for(int i = 0; i < nadc; ++i)
+        {
+            iw(i, 0) = 0;
+            fw(i, 0) = 0.;
+        }
+
+        for(int ipk = 1; ipk <= npk; ++ipk)
+        {
+            int ic = ipnpk[ipk - 1];
+            if(iter != 1)
+                ratio = fw(ic, ipk)/fw(ic, npk + 1);
+            float eg = id[ic]*ratio;
+            int ixypk = ia[ic];
+            int ixpk = ixypk/100;
+            int iypk = ixypk - ixpk*100;
+            epk[ipk - 1] = eg;
+            xpk[ipk - 1] = eg*ixpk;
+            ypk[ipk - 1] = eg*iypk;
+
+            for(int in = ic + 1; in < nadc; ++in)
+            {
+                int ixy = ia[in];
+                int ix = ixy/100;
+                int iy = ixy - ix*100;
+                if(ixy - ixypk > 100 + 1)
+                    break;
+                if(std::abs(iy - iypk) <= 1) {
+                    if(iter != 1)
+                        ratio = fw(in, ipk)/fw(in, npk + 1);
+                    eg = id[in]*ratio;
+                    epk[ipk - 1] = epk[ipk - 1] + eg;
+                    xpk[ipk - 1] = xpk[ipk - 1] + eg*ix;
+                    ypk[ipk - 1] = ypk[ipk - 1] + eg*iy;
+                }
+            }
+
+            for(int in = ic - 1; in >= 0; --in)
+            {
+                int ixy = ia[in];
+                int ix = ixy/100;
+                int iy = ixy - ix*100;
+                if(ixypk - ixy > 100 + 1)
+                    break;
+                if(std::abs(iy - iypk) <= 1) {
+                    if(iter != 1)
+                        ratio = fw(in, ipk)/fw(in, npk + 1);
+                    eg = id[in]*ratio;
+                    epk[ipk - 1] = epk[ipk - 1] + eg;
+                    xpk[ipk - 1] = xpk[ipk - 1] + eg*ix;
+                    ypk[ipk - 1] = ypk[ipk - 1] + eg*iy;
+                }
+            }
+
+            if(epk[ipk - 1] > 0.) {
+                xpk[ipk - 1] = xpk[ipk - 1]/epk[ipk - 1];
+                ypk[ipk - 1] = ypk[ipk - 1]/epk[ipk - 1];
+            } else {
+                std::cout << "PRad Primex Island Warning: Lost maximum with peak energy "
+                          << id[ic]*1e-4 << " at iteration " << iter
+                          << std::endl;
+            }
+
+            for(int i = 0; i < nadc; ++i)
+            {
+                int ixy = ia[i];
+                int ix = ixy/100;
+                int iy = ixy - ix*100;
+                float dx = std::abs(ix - xpk[ipk - 1]);
+                float dy = std::abs(iy - ypk[ipk - 1]);
+                float a = epk[ipk - 1]*cell(sect, dx, dy);
+                iw(i, ipk) = __pi_nint(a);
+                fw(i, ipk) = a;
+                iw(i, 0) = iw(i, 0) + iw(i, ipk);
+                fw(i, 0) = fw(i, 0) + fw(i, ipk);
+            }
+        }
+
+        for(int i = 0; i < nadc; ++i)
+        {
+            int iwk = iw(i, 0);
+            if(iwk <= 0) iwk = 1;
+            iw(i, npk + 1) = iwk;
+            if(fw(i, 0) > 1e-2f)
+                fw(i, npk + 1) = fw(i, 0);
+            else
+                fw(i, npk + 1) = 1e-2f;
+        }
+    }
+
+    // one gamma in each peak, they are only for a better (E, x, y) estimation
+    std::vector<Gamma> &pre = ws.pre_gammas;
+    pre.clear();
+    int igmpk[ISLAND_MAX_PEAKS];
+    for(int ipk = 1; ipk <= npk; ++ipk)
+    {
+        int leng = 0;
+        for(int i = 0; i < nadc; ++i)
+        {
+            if(fw(i, 0) > 1e-2f) {
+                // part of cell energy #i belonging to peak #ipk
+                float fe = id[i]*fw(i, ipk)/fw(i, 0);
+                if(fe > 0.) {
+                    iw(leng, npk + 1) = ia[i];
+                    iw(leng, npk + 2) = __pi_nint(fe);
+                    fw(leng, npk + 1) = ia[i];
+                    fw(leng, npk + 2) = fe;
+                    leng++;
+                }
+            }
+        }
+        if(gammas.size() + pre.size() >= MAX_GAMMAS - 1) {
+            // the fortran code stops here and leaves the preliminary gammas
+            // as the results, their cell lists are not filled
+            gammas.insert(gammas.end(), pre.begin(), pre.end());
+            return;
+        }
+        igmpk[ipk - 1] = -1;
+        if(leng == 0)
+            continue;
+
+        int ic = ipnpk[ipk - 1];
+        int ix = ia[ic]/100;
+        int iy = ia[ic] - ix*100;
+        int itype = peakType(sect, ix, iy);
+
+        chisq = ISLAND_CHISQ1;
+        gammaFit(sect, stat, leng, &iw(0, npk + 1), &iw(0, npk + 2), chisq, e1, x1, y1, ws);
+
+        pre.emplace_back();
+        Gamma &gam = pre.back();
+        gam.chi2 = chisq;
+        gam.type = itype;
+        gam.energy = e1;
+        gam.x = x1;
+        gam.y = y1;
+        gam.dime = leng;
+        gam.id = 90;
+        gam.status = itype;
+        igmpk[ipk - 1] = pre.size() - 1;
+    }
+
+    // second step, share the cell energies according to the preliminary gammas
+    for(int i = 0; i < nadc; ++i)
+    {
+        iw(i, 0) = 0;
+        fw(i, 0) = 0.;
+        dp(i, 0) = 0;
+    }
+
+    for(int ipk = 1; ipk <= npk; ++ipk)
+    {
+        for(int i = 0; i < nadc; ++i)
+        {
+            iw(i, ipk) = 0;
+            fw(i, ipk) = 0.;
+            dp(i, ipk) = 0;
+            if(igmpk[ipk - 1] < 0)
+                continue;
+
+            const Gamma &gam = pre[igmpk[ipk - 1]];
+            int ixy = ia[i];
+            int ix = ixy/100;
+            int iy = ixy - ix*100;
+            float dx = ix - gam.x;
+            float dy = iy - gam.y;
+
+            float fia = gam.energy*cell(sect, dx, dy);
+            int iia = __pi_nint(fia);
+
+            iw(i, ipk) = iw(i, ipk) + iia;
+            fw(i, ipk) = fw(i, ipk) + fia;
+            dp(i, ipk) = dp(i, ipk) + iia;
+            iw(i, 0) = iw(i, 0) + iia;
+            fw(i, 0) = fw(i, 0) + fia;
+        }
+    }
+
+    // recover working array, renormalize total sum to the original cell energy
+    float fwt[ISLAND_MAX_PEAKS];
+    for(int i = 0; i < nadc; ++i)
+    {
+        dp(i, 0) = 0;
+        for(int ipk = 1; ipk <= npk; ++ipk)
+            dp(i, 0) = dp(i, 0) + dp(i, ipk);
+
+        int ide = id[i] - dp(i, 0);
+        if(ide == 0 || fw(i, 0) == 0.)
+            continue;
+
+        for(int ipk = 1; ipk <= npk; ++ipk)
+            fwt[ipk - 1] = fw(i, ipk)/fw(i, 0);
+
+        for(int ipk = 1; ipk <= npk; ++ipk)
+        {
+            float fia = ide*fwt[ipk - 1];
+            if(fw(i, ipk) + fia > 0.) {
+                fw(i, ipk) = fw(i, ipk) + fia;
+                fw(i, 0) = fw(i, 0) + fia;
+            }
+            int iia = __pi_nint(fia);
+            if(iw(i, ipk) + iia > 0) {
+                iw(i, ipk) = iw(i, ipk) + iia;
+                iw(i, 0) = iw(i, 0) + iia;
+            } else if(iw(i, ipk) + iia < 0) {
+                std::cout << "PRad Primex Island Warning: Negative correction "
+                          << ia[i] << ", " << id[i]
+                          << std::endl;
+            }
+        }
+    }
+
+    // reanalyze the gammas
+    for(int ipk = 1; ipk <= npk; ++ipk)
+    {
+        int leng = 0;
+        for(int i = 0; i < nadc; ++i)
+        {
+            if(iw(i, 0) > 0) {
+                float fe = id[i]*fw(i, ipk)/fw(i, 0);
+                if(fe > 0.) {
+                    iw(leng, npk + 1) = ia[i];
+                    fw(leng, npk + 1) = ia[i];
+                    iw(leng, npk + 2) = __pi_nint(fe);
+                    fw(leng, npk + 2) = fe;
+                    leng++;
+                }
+            }
+        }
+        if(gammas.size() >= MAX_GAMMAS - 1)
+            return;
+        if(leng == 0)
+            continue;
+
+        int ic = ipnpk[ipk - 1];
+        int ix = ia[ic]/100;
+        int iy = ia[ic] - ix*100;
+        int itype = peakType(sect, ix, iy);
+
+        chisq = ISLAND_CHISQ2;
+        gammaFit(sect, stat, leng, &iw(0, npk + 1), &iw(0, npk + 2), chisq, e1, x1, y1, ws);
+
+        gammas.emplace_back();
+        Gamma &gam = gammas.back();
+        gam.chi2 = chisq;
+        gam.type = itype;
+        gam.energy = e1;
+        gam.x = x1;
+        gam.y = y1;
+        gam.dime = leng;
+        gam.id = 10;
+        gam.status = itype;
+        gam.nhits = std::min(leng, MAX_CC);
+        for(int j = 0; j < gam.nhits; ++j)
+        {
+            gam.index[j] = iw(j, npk + 1);
+            gam.iener[j] = iw(j, npk + 2);
+        }
+    }
+}
+
+// fit one gamma in a peak, gamma_hyc in island.F
+// the fortran code returns before trying to separate the peak into two gammas
+// (tgamma_hyc), so only one gamma is fitted here
+void PRadPrimexIsland::gammaFit(const Sector &sect, const Matrix &stat,
+                                int nadc, const int *ia, const int *id,
+                                float &chisq, float &e1, float &x1, float &y1,
+                                Workspace &ws)
+const
+{
+    // in the units of cell size
+    const float dxy = .05f, stepmin = .002f;
+
+    int nzero = fillZeros(sect, stat, nadc, ia, ws);
+    const int *iaz = ws.iaz.data();
+
+    // initial values of e, x, y
+    mom1(sect, nadc, ia, id, nzero, iaz, e1, x1, y1);
+    if(nadc <= 0)
+        return;
+
+    // initial value of chi2
+    float chi0 = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x1, y1);
+    float chisq0 = chi0;
+    int dof = std::max(1, nzero + nadc - 2);
+    chisq = chi0/dof;
+    float x0 = x1, y0 = y1;
+
+    while(true)
+    {
+        float chir = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x0 + dxy, y0);
+        float chil = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x0 - dxy, y0);
+        float chiu = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x0, y0 + dxy);
+        float chid = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x0, y0 - dxy);
+
+        float stepx, stepy;
+        if(chi0 > chir || chi0 > chil) {
+            stepx = dxy;
+            if(chir > chil) stepx = -stepx;
+        } else {
+            stepx = 0.;
+            float parx = chir + chil - 2.f*chi0;
+            if(parx > 0.) stepx = -(dxy*(chir - chil)/(2.f*parx));
+        }
+        if(chi0 > chiu || chi0 > chid) {
+            stepy = dxy;
+            if(chiu > chid) stepy = -stepy;
+        } else {
+            stepy = 0.;
+            float pary = chiu + chid - 2.f*chi0;
+            if(pary > 0.) stepy = -(dxy*(chiu - chid)/(2.f*pary));
+        }
+
+        // steps at minimum
+        if(std::abs(stepx) < stepmin && std::abs(stepy) < stepmin)
+            break;
+
+        float chi00 = chisq1(sect, nadc, ia, id, nzero, iaz, e1, x0 + stepx, y0 + stepy);
+
+        // chi2 at minimum
+        if(chi00 >= chi0)
+            break;
+
+        chi0 = chi00;
+        x0 = x0 + stepx;
+        y0 = y0 + stepy;
+    }
+
+    // chi2 improved
+    if(chi0 < chisq0) {
+        x1 = x0;
+        y1 = y0;
+        chisq = chi0/dof;
+    }
+}
+
+// neighbors of the cluster that are supposed to have 0 energy, fill_zeros in
+// island.F, the order of the list is kept
+int PRadPrimexIsland::fillZeros(const Sector &sect, const Matrix &stat,
+                                int nadc, const int *ia, Workspace &ws)
+const
+{
+    std::vector<char> &mark = ws.mark;
+    mark.resize((MCOL + 2)*100);
+    std::vector<int> &ian = ws.iaz;
+    ian.clear();
+
+    for(int i = 0; i < nadc; ++i)
+        mark[ia[i]] = 1;
+
+    auto add_neighbor = [&] (int ixy) {
+        if(mark[ixy])
+            return;
+        mark[ixy] = 1;
+        ian.push_back(ixy);
+    };
+
+    const int &ncol = sect.ncol, &nrow = sect.nrow;
+    for(int i = 0; i < nadc; ++i)
+    {
+        int ix = ia[i]/100;
+        int iy = ia[i] - ix*100;
+        if(ix > 1) {
+            add_neighbor(iy + (ix - 1)*100);
+            if(iy > 1) add_neighbor(iy - 1 + (ix - 1)*100);
+            if(iy < nrow) add_neighbor(iy + 1 + (ix - 1)*100);
+        }
+        if(ix < ncol) {
+            add_neighbor(iy + (ix + 1)*100);
+            if(iy > 1) add_neighbor(iy - 1 + (ix + 1)*100);
+            if(iy < nrow) add_neighbor(iy + 1 + (ix + 1)*100);
+        }
+        if(iy > 1) add_neighbor(iy - 1 + ix*100);
+        if(iy < nrow) add_neighbor(iy + 1 + ix*100);
+    }
+
+    // reset the marks and keep the good modules only
+    for(int i = 0; i < nadc; ++i)
+        mark[ia[i]] = 0;
+
+    size_t nneib = 0;
+    for(auto &ixy : ian)
+    {
+        mark[ixy] = 0;
+        int ix = ixy/100;
+        int iy = ixy - ix*100;
+        if(stat[ix - 1][iy - 1] == 0)
+            ian[nneib++] = ixy;
+    }
+    ian.resize(nneib);
+
+    return nneib;
+}
+
+// first momenta, mom1_pht in island.F
+void PRadPrimexIsland::mom1(const Sector &sect, int nadc, const int *ia, const int *id,
+                            int nzero, const int *iaz, float &a0, float &x0, float &y0)
+const
+{
+    a0 = 0.;
+    x0 = 0.;
+    y0 = 0.;
+    if(nadc <= 0)
+        return;
+
+    for(int i = 0; i < nadc; ++i)
+    {
+        float a = id[i];
+        int ix = ia[i]/100;
+        int iy = ia[i] - ix*100;
+        a0 = a0 + a;
+        x0 = x0 + a*ix;
+        y0 = y0 + a*iy;
+    }
+    if(a0 <= 0.)
+        return;
+    x0 = x0/a0;
+    y0 = y0/a0;
+
+    // correction for delta
+    float corr = 0.;
+    for(int i = 0; i < nadc; ++i)
+    {
+        int ix = ia[i]/100;
+        int iy = ia[i] - ix*100;
+        corr = corr + cell(sect, float(ix) - x0, float(iy) - y0);
+    }
+    for(int i = 0; i < nzero; ++i)
+    {
+        int ix = iaz[i]/100;
+        int iy = iaz[i] - ix*100;
+        corr = corr + cell(sect, float(ix) - x0, float(iy) - y0);
+    }
+    corr = corr/1.006f;
+
+    if(corr < .8f)
+        corr = .8f;
+    else if(corr > 1.)
+        corr = 1.;
+
+    a0 = a0/corr;
+}
+
+// chi2 of one gamma, chisq1_hyc in island.F
+float PRadPrimexIsland::chisq1(const Sector &sect, int nadc, const int *ia, const int *id,
+                               int nzero, const int *iaz, float e1, float x1, float y1)
+const
+{
+    float chisq = 0.;
+
+    // cannot happen since there is always energy in the cells
+    if(e1 == 0.) {
+        for(int i = 0; i < nadc; ++i)
+            chisq = chisq + float(id[i]*id[i])/9.f;
+        return chisq;
+    }
+
+    for(int i = 0; i < nadc; ++i)
+    {
+        int ix = ia[i]/100;
+        int iy = ia[i] - ix*100;
+        if(std::abs(x1 - ix) > 6.f || std::abs(y1 - iy) > 6.f)
+            continue;
+
+        float fcell = cell(sect, x1 - ix, y1 - iy);
+        float diff = fcell - id[i]/e1;
+        chisq = chisq + e1*(diff*diff)/sigma2(sect, x1 - ix, y1 - iy, fcell, e1);
+    }
+
+    for(int i = 0; i < nzero; ++i)
+    {
+        int ix = iaz[i]/100;
+        int iy = iaz[i] - ix*100;
+        if(std::abs(x1 - ix) > 6.f || std::abs(y1 - iy) > 6.f)
+            continue;
+
+        float fcell = cell(sect, x1 - ix, y1 - iy);
+        chisq = chisq + e1*(fcell*fcell)/sigma2(sect, x1 - ix, y1 - iy, fcell, e1);
+    }
+
+    return chisq;
+}
+
+// sigma_e^2/e = sigma_f^2*e, units are 10 MeV, sigma2 in island.F with test_p
+float PRadPrimexIsland::sigma2(const Sector &sect, float dx, float dy, float fc, float e)
+const
+{
+    const float alp = 0.816f, bet1 = 32.1f, bet2 = 1.72f;
+
+    if(dx*dx + dy*dy > 25.f)
+        return 100.;
+
+    // 0.2 for ped-sigma and 10/sqrt(12)
+    float sig2 = alp*fc + (bet1 + bet2*std::sqrt(e/100.f))*d2c(sect, dx, dy)
+               + 0.2f/(e/100.f);
+    sig2 = sig2/std::pow(0.0001f*e, 0.166f);
+    return 100.f*sig2;
+}
+
+// peak_type in island.F
+int PRadPrimexIsland::peakType(const Sector &sect, int ix, int iy)
+const
+{
+    const int &ncol = sect.ncol, &nrow = sect.nrow;
+    int itype = 0;
+
+    switch(sect.isect)
+    {
+    case 0:
+        // hole/outer boundary
+        if((ix == ncol/2 - 1 || ix == ncol/2 + 2) && iy >= nrow/2 - 1 && iy <= nrow/2 + 2)
+            itype = 1;
+        if((iy == nrow/2 - 1 || iy == nrow/2 + 2) && ix >= ncol/2 - 1 && ix <= ncol/2 + 2)
+            itype = 1;
+        // transition (PWO/LG or LG/LG)
+        if(ix == 1 || ix == ncol || iy == 1 || iy == nrow)
+            itype = 2;
+        break;
+    case 1:
+        if(ix == 1 || iy == 1) itype = 1;
+        if(ix == ncol || iy == nrow) itype = 2;
+        break;
+    case 2:
+        if(ix == ncol || iy == 1) itype = 1;
+        if(ix == 1 || iy == nrow) itype = 2;
+        break;
+    case 3:
+        if(ix == ncol || iy == nrow) itype = 1;
+        if(ix == 1 || iy == 1) itype = 2;
+        break;
+    case 4:
+        if(ix == 1 || iy == nrow) itype = 1;
+        if(ix == ncol || iy == 1) itype = 2;
+        break;
+    default:
+        break;
+    }
+
+    return itype;
+}
+
+// convert units and sort the gammas, out_hyc in island.F
+void PRadPrimexIsland::output(const Sector &sect, std::vector<Gamma> &gammas)
+const
+{
+    for(auto &gam : gammas)
+    {
+        // 0.1 MeV to GeV
+        gam.energy = gam.energy/10000.f;
+        gam.x = (sect.ncol + 1 - 2.f*gam.x)*sect.xsize/2.f;
+        gam.y = (sect.nrow + 1 - 2.f*gam.y)*sect.ysize/2.f;
+        // the fortran code replaces the peak type with the id
+        gam.type = gam.id;
+    }
+
+    // the same swaps as the fortran code, so the gammas with equal energies
+    // are in the same order
+    for(size_t i = 0; i < gammas.size(); ++i)
+    {
+        for(size_t j = i + 1; j < gammas.size(); ++j)
+        {
+            if(gammas[i].energy < gammas[j].energy)
+                std::swap(gammas[i], gammas[j]);
+        }
+    }
+}
+
+// bilinear interpolation in a profile table, cell_hyc and d2c in island.F
+float PRadPrimexIsland::interp(const std::shared_ptr<const std::vector<float>> &table,
+                               float x, float y, float out_range)
+{
+    if(!table)
+        return 0.;
+
+    float ax = std::abs(x*100.f);
+    float ay = std::abs(y*100.f);
+    int i = int(ax);
+    int j = int(ay);
+
+    if(i >= ISLAND_PROF_STEPS - 1 || j >= ISLAND_PROF_STEPS - 1)
+        return out_range;
+
+    float wx = ax - i;
+    float wy = ay - j;
+    const float *a = table->data() + i*ISLAND_PROF_STEPS + j;
+
+    return a[0]*(1.f - wx)*(1.f - wy)
+         + a[ISLAND_PROF_STEPS]*wx*(1.f - wy)
+         + a[1]*(1.f - wx)*wy
+         + a[ISLAND_PROF_STEPS + 1]*wx*wy;
+}
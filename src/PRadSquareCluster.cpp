@@ -15,6 +15,20 @@
 
 const PRadClusterProfile &__sc_prof = PRadClusterProfile::Instance();
 
+// clusters of the current event that cover each module in the table, the
+// first entry is indexed by the module id, the others are linked by the entry
+struct __sc_cover
+{
+    int cluster;
+    int next;
+
+    __sc_cover(int c, int n) : cluster(c), next(n) {};
+};
+static thread_local std::vector<int> __sc_cover_head;
+static thread_local std::vector<__sc_cover> __sc_covers;
+// clusters seeded on the modules not in the table
+static thread_local std::vector<unsigned int> __sc_free_seeds;
+
 PRadSquareCluster::PRadSquareCluster(const std::string &path)
 {
     Configure(path);
@@ -39,6 +53,62 @@ void PRadSquareCluster::Configure(const std::string &path)
     bool verbose = (!path.empty());
 
     square_size = getDefConfig<unsigned int>("Square Size", 5, verbose);
+
+    // the table depends on the square size, it needs to be built again
+    clearSeedTable();
+}
+
+// the square method also looks up the seeds that can cover a hit from a table
+void PRadSquareCluster::BuildModuleTables(const std::vector<PRadHyCalModule*> &mlist)
+{
+    PRadHyCalCluster::BuildModuleTables(mlist);
+    buildSeedTable(mlist);
+}
+
+// find the modules covered by the square of each module, the clusters seeded
+// on a module mark these modules so a hit can find its clusters directly
+void PRadSquareCluster::buildSeedTable(const std::vector<PRadHyCalModule*> &mlist)
+{
+    clearSeedTable();
+
+    std::vector<ModuleHit> mhits;
+    mhits.reserve(mlist.size());
+    int max_id = -1;
+    for(auto module : mlist)
+    {
+        mhits.emplace_back(module, 0.);
+        max_id = std::max(max_id, mhits.back().id);
+    }
+
+    if(max_id < 0)
+        return;
+
+    std::vector<std::vector<int>> covers(max_id + 1);
+    seed_geo.resize(max_id + 1, (unsigned int)-1);
+    for(auto &center : mhits)
+    {
+        seed_geo[center.id] = center.geo_index;
+        for(auto &hit : mhits)
+        {
+            if(checkBelongs(center, hit, float(square_size)/2.))
+                covers[center.id].push_back(hit.id);
+        }
+    }
+
+    cover_offset.resize(max_id + 2, 0);
+    for(int id = 0; id <= max_id; ++id)
+    {
+        cover_offset[id + 1] = cover_offset[id] + covers[id].size();
+        cover_modules.insert(cover_modules.end(), covers[id].begin(), covers[id].end());
+    }
+}
+
+// clear the table, the clustering checks all the clusters for a hit then
+void PRadSquareCluster::clearSeedTable()
+{
+    seed_geo.clear();
+    cover_offset.clear();
+    cover_modules.clear();
 }
 
 inline bool PRadSquareCluster::checkBelongs(const ModuleHit &center,
@@ -46,11 +116,12 @@ inline bool PRadSquareCluster::checkBelongs(const ModuleHit &center,
                                             float factor)
 const
 {
-    float dist_x = factor*center.geo.size_x;
-    float dist_y = factor*center.geo.size_y;
+    const auto &cgeo = center.GetGeometry(), &hgeo = hit.GetGeometry();
+    float dist_x = factor*cgeo.size_x;
+    float dist_y = factor*cgeo.size_y;
 
-    if((fabs(center.geo.x - hit.geo.x) > dist_x) ||
-       (fabs(center.geo.y - hit.geo.y) > dist_y))
+    if((fabs(cgeo.x - hgeo.x) > dist_x) ||
+       (fabs(cgeo.y - hgeo.y) > dist_y))
         return false;
 
     return true;
@@ -78,31 +149,77 @@ const
                   return m1.energy > m2.energy;
               });
 
+    // no seeds yet
+    if(__sc_cover_head.size() != seed_geo.size())
+        __sc_cover_head.assign(seed_geo.size(), -1);
+    __sc_covers.clear();
+    __sc_free_seeds.clear();
+
     // loop over all hits
     for(auto &hit : hits)
     {
         // not belongs to any cluster, and the energy is larger than center threshold
         if(!fillClusters(hit, clusters) && (hit.energy > min_center_energy))
         {
+            int index = clusters.size();
             clusters.emplace_back(hit);
             clusters.back().AddHit(hit);
+
+            // mark the modules covered by the new cluster
+            if(isIndexed(hit)) {
+                for(unsigned int k = cover_offset[hit.id]; k < cover_offset[hit.id + 1]; ++k)
+                {
+                    int &head = __sc_cover_head[cover_modules[k]];
+                    __sc_covers.emplace_back(index, head);
+                    head = __sc_covers.size() - 1;
+                }
+            } else {
+                __sc_free_seeds.push_back(index);
+            }
         }
     }
+
+    // only reset the modules covered by the clusters
+    for(auto &cluster : clusters)
+    {
+        if(!isIndexed(cluster.center))
+            continue;
+
+        int id = cluster.center.id;
+        for(unsigned int k = cover_offset[id]; k < cover_offset[id + 1]; ++k)
+            __sc_cover_head[cover_modules[k]] = -1;
+    }
 }
 
 bool PRadSquareCluster::fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &c)
 const
 {
-    std::vector<unsigned int> indices;
-    indices.reserve(50);
+    static thread_local std::vector<unsigned int> indices;
+    indices.clear();
 
     // check how many clusters the hit belongs to
-    for(unsigned int i = 0; i < c.size(); ++i)
-    {
-        const auto &center = c.at(i).center;
-        // within the square range
-        if(checkBelongs(center, hit, float(square_size)/2.)) {
-            indices.push_back(i);
+    if(isIndexed(hit)) {
+        // clusters that cover the module of this hit
+        for(int k = __sc_cover_head[hit.id]; k >= 0; k = __sc_covers[k].next)
+            indices.push_back(__sc_covers[k].cluster);
+
+        for(auto i : __sc_free_seeds)
+        {
+            if(checkBelongs(c.at(i).center, hit, float(square_size)/2.))
+                indices.push_back(i);
+        }
+
+        // keep the order of the clusters, same as checking them one by one
+        if(indices.size() > 1)
+            std::sort(indices.begin(), indices.end());
+    } else {
+        for(unsigned int i = 0; i < c.size(); ++i)
+        {
+            const auto &center = c.at(i).center;
+            // within the square range
+            if(checkBelongs(center, hit, float(square_size)/2.)) {
+                indices.push_back(i);
+            }
         }
     }
 
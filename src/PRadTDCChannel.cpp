@@ -20,7 +20,7 @@ PRadTDCChannel::PRadTDCChannel(const std::string &name, const ChannelAddress &ad
 : PRadDAQChannel(name, addr)
 {
     std::string tdc_name = "TDC_" + name;
-    tdc_hist = new TH1I(tdc_name.c_str(), "Time Measure", 20000, 0, 19999);
+    tdc_hist = new PRadHistogram(new TH1I(tdc_name.c_str(), "Time Measure", 20000, 0, 19999));
 }
 
 // copy/move constructors
@@ -29,7 +29,7 @@ PRadTDCChannel::PRadTDCChannel(const PRadTDCChannel &that)
 : PRadDAQChannel(that), time_measure(that.time_measure)
 {
     if(that.tdc_hist)
-        tdc_hist = (TH1*) that.tdc_hist->Clone();
+        tdc_hist = new PRadHistogram(*that.tdc_hist);
     else
         tdc_hist = nullptr;
 }
@@ -55,7 +55,7 @@ PRadTDCChannel &PRadTDCChannel::operator =(const PRadTDCChannel &rhs)
 
     PRadDAQChannel::operator =(rhs);
     if(rhs.tdc_hist)
-        tdc_hist = (TH1*) rhs.tdc_hist->Clone();
+        tdc_hist = new PRadHistogram(*rhs.tdc_hist);
     time_measure = rhs.time_measure;
 
     return *this;
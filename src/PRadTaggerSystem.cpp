@@ -18,15 +18,15 @@
 // constructor
 PRadTaggerSystem::PRadTaggerSystem()
 {
-    hist_E = new TH2I("Tagger E", "Tagger E counter", 2000, 0, 20000, 384, 0, 383);
-    hist_T = new TH2I("Tagger T", "Tagger T counter", 2000, 0, 20000, 128, 0, 127);
+    hist_E = new PRadHistogram(new TH2I("Tagger E", "Tagger E counter", 2000, 0, 20000, 384, 0, 383));
+    hist_T = new PRadHistogram(new TH2I("Tagger T", "Tagger T counter", 2000, 0, 20000, 128, 0, 127));
 }
 
 // copy/move constructors
 PRadTaggerSystem::PRadTaggerSystem(const PRadTaggerSystem &that)
 {
-    hist_E = new TH2I(*that.hist_E);
-    hist_T = new TH2I(*that.hist_T);
+    hist_E = new PRadHistogram(*that.hist_E);
+    hist_T = new PRadHistogram(*that.hist_T);
 }
 
 PRadTaggerSystem::PRadTaggerSystem(PRadTaggerSystem &&that)
@@ -58,7 +58,9 @@ PRadTaggerSystem &PRadTaggerSystem::operator =(PRadTaggerSystem &&rhs)
     delete hist_T;
 
     hist_E = rhs.hist_E;
+    rhs.hist_E = nullptr;
     hist_T = rhs.hist_T;
+    rhs.hist_T = nullptr;
 
     return *this;
 }
@@ -114,3 +116,16 @@ void PRadTaggerSystem::FillHists(const EventData &event)
             hist_E->Fill(tdc.value, id);
     }
 }
+
+// get hists, the ROOT histograms are updated here
+TH2I *PRadTaggerSystem::GetECounterHist()
+const
+{
+    return static_cast<TH2I*>(hist_E->GetHist());
+}
+
+TH2I *PRadTaggerSystem::GetTCounterHist()
+const
+{
+    return static_cast<TH2I*>(hist_T->GetHist());
+}
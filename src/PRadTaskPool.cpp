@@ -0,0 +1,108 @@
+//============================================================================//
+// A pool of persistent threads that runs batches of independent jobs         //
+// The threads are created once and wait for the next batch, so the pool can  //
+// be used within every event without paying for thread creation             //
+//============================================================================//
+
+#include "PRadTaskPool.h"
+
+
+
+PRadTaskPool::PRadTaskPool(unsigned int t)
+: nthreads(1)
+{
+#ifdef MULTI_THREAD
+    nthreads = (t > 0) ? t : std::thread::hardware_concurrency();
+    if(nthreads < 1)
+        nthreads = 1;
+
+    task = nullptr;
+    task_jobs = 0;
+    next_job = 0;
+    active = 0;
+    batch = 0;
+    stop = false;
+
+    // the calling thread is one of the workers
+    for(unsigned int i = 1; i < nthreads; ++i)
+        workers.emplace_back(&PRadTaskPool::workerLoop, this);
+#else
+    (void) t;
+#endif
+}
+
+PRadTaskPool::~PRadTaskPool()
+{
+#ifdef MULTI_THREAD
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        stop = true;
+    }
+    start_cv.notify_all();
+
+    for(auto &worker : workers)
+        worker.join();
+#endif
+}
+
+// run func(job) for all jobs in [0, njobs), return when they are all done
+void PRadTaskPool::Run(size_t njobs, const std::function<void(size_t)> &func)
+{
+#ifdef MULTI_THREAD
+    std::unique_lock<std::mutex> run_lock(run_locker, std::try_to_lock);
+
+    if(run_lock.owns_lock() && !workers.empty() && njobs > 1) {
+        {
+            std::lock_guard<std::mutex> lock(locker);
+            task = &func;
+            task_jobs = njobs;
+            next_job = 0;
+            active = workers.size();
+            ++batch;
+        }
+        start_cv.notify_all();
+
+        doJobs();
+
+        // wait for the workers to finish their last jobs
+        std::unique_lock<std::mutex> lock(locker);
+        done_cv.wait(lock, [this] () {return active == 0;});
+        task = nullptr;
+        return;
+    }
+#endif
+
+    for(size_t job = 0; job < njobs; ++job)
+        func(job);
+}
+
+#ifdef MULTI_THREAD
+// worker threads wait for a new batch and take the jobs one by one
+void PRadTaskPool::workerLoop()
+{
+    unsigned long done_batch = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(locker);
+            start_cv.wait(lock, [&] () {return stop || batch != done_batch;});
+            if(stop)
+                return;
+            done_batch = batch;
+        }
+
+        doJobs();
+
+        std::lock_guard<std::mutex> lock(locker);
+        if(--active == 0)
+            done_cv.notify_one();
+    }
+}
+
+void PRadTaskPool::doJobs()
+{
+    for(size_t job = next_job++; job < task_jobs; job = next_job++)
+        (*task)(job);
+}
+#endif